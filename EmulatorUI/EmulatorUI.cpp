@@ -13,7 +13,7 @@ void cycleCallback(void* client) {
 
 void EmulatorUI::startEmulation()
 {
-	cpu::getInstance()->emulateCycle();
+	core.emulateCycle();
 }
 
 EmulatorUI::EmulatorUI(QWidget *parent)
@@ -24,18 +24,20 @@ EmulatorUI::EmulatorUI(QWidget *parent)
 	ui.actionRun->setEnabled(false);
 	ui.actionStop->setEnabled(false);
 	isInitialized = false;
+	//the LEDs are watched by a person, so run at the emulated clock's speed
+	core.setRealTime(true);
 	
-	LEDsSequence* leds = new LEDsSequence(ui.centralWidget);
+	LEDsSequence* leds = new LEDsSequence(ui.centralWidget, &core);
 	leds->move(10, 10);
 
-	worker = new Worker(this);
+	worker = new Worker(this, &core);
 	connect(worker, SIGNAL(updateUI()), this, SLOT(displayCycle()));
 	connect(worker, SIGNAL(updateUI()), leds, SLOT(update()));
 
 	connect(ui.actionLoad, &QAction::triggered, [=]() {
 		worker->stop();
 		auto name = QFileDialog::getOpenFileName(this, "Open Hex File", "", "HEX | *.hex");
-		isInitialized = cpu::getInstance()->initialize(name.toStdString(), cycleCallback, worker);
+		isInitialized = core.initialize(name.toStdString(), cycleCallback, worker);
 		if (isInitialized) {
 			ui.statusBar->showMessage("Loaded " + name);
 			ui.actionRun->setEnabled(true);
@@ -86,39 +88,39 @@ void EmulatorUI::closeEvent(QCloseEvent* event)
 
 void EmulatorUI::displayCycle()
 {
-	ui.p0->setText(QString("0x%1").arg(cpu::getInstance()->getP0(), 2, 16, QLatin1Char('0')));
-	ui.p1->setText(QString("0x%1").arg(cpu::getInstance()->getP1(), 2, 16, QLatin1Char('0')));
-	ui.p2->setText(QString("0x%1").arg(cpu::getInstance()->getP2(), 2, 16, QLatin1Char('0')));
-	ui.p2->setText(QString("0x%1").arg(cpu::getInstance()->getP3(), 2, 16, QLatin1Char('0')));
+	ui.p0->setText(QString("0x%1").arg(core.getP0(), 2, 16, QLatin1Char('0')));
+	ui.p1->setText(QString("0x%1").arg(core.getP1(), 2, 16, QLatin1Char('0')));
+	ui.p2->setText(QString("0x%1").arg(core.getP2(), 2, 16, QLatin1Char('0')));
+	ui.p2->setText(QString("0x%1").arg(core.getP3(), 2, 16, QLatin1Char('0')));
 
-	ui.r0->setText(QString("0x%1").arg(cpu::getInstance()->getR0(), 2, 16, QLatin1Char('0')));
-	ui.r1->setText(QString("0x%1").arg(cpu::getInstance()->getR1(), 2, 16, QLatin1Char('0')));
-	ui.r2->setText(QString("0x%1").arg(cpu::getInstance()->getR2(), 2, 16, QLatin1Char('0')));
-	ui.r3->setText(QString("0x%1").arg(cpu::getInstance()->getR3(), 2, 16, QLatin1Char('0')));
-	ui.r4->setText(QString("0x%1").arg(cpu::getInstance()->getR4(), 2, 16, QLatin1Char('0')));
-	ui.r5->setText(QString("0x%1").arg(cpu::getInstance()->getR5(), 2, 16, QLatin1Char('0')));
-	ui.r6->setText(QString("0x%1").arg(cpu::getInstance()->getR6(), 2, 16, QLatin1Char('0')));
-	ui.r7->setText(QString("0x%1").arg(cpu::getInstance()->getR7(), 2, 16, QLatin1Char('0')));
+	ui.r0->setText(QString("0x%1").arg(core.getR0(), 2, 16, QLatin1Char('0')));
+	ui.r1->setText(QString("0x%1").arg(core.getR1(), 2, 16, QLatin1Char('0')));
+	ui.r2->setText(QString("0x%1").arg(core.getR2(), 2, 16, QLatin1Char('0')));
+	ui.r3->setText(QString("0x%1").arg(core.getR3(), 2, 16, QLatin1Char('0')));
+	ui.r4->setText(QString("0x%1").arg(core.getR4(), 2, 16, QLatin1Char('0')));
+	ui.r5->setText(QString("0x%1").arg(core.getR5(), 2, 16, QLatin1Char('0')));
+	ui.r6->setText(QString("0x%1").arg(core.getR6(), 2, 16, QLatin1Char('0')));
+	ui.r7->setText(QString("0x%1").arg(core.getR7(), 2, 16, QLatin1Char('0')));
 
-	ui.b->setText(QString("0x%1").arg(cpu::getInstance()->getB(), 2, 16, QLatin1Char('0')));
-	ui.acc->setText(QString("0x%1").arg(cpu::getInstance()->getACC(), 2, 16, QLatin1Char('0')));
-	ui.ip->setText(QString("0x%1").arg(cpu::getInstance()->getIP(), 2, 16, QLatin1Char('0')));
-	ui.ie->setText(QString("0x%1").arg(cpu::getInstance()->getIE(), 2, 16, QLatin1Char('0')));
-	ui.tmod->setText(QString("0x%1").arg(cpu::getInstance()->getTMOD(), 2, 16, QLatin1Char('0')));
-	ui.tcon->setText(QString("0x%1").arg(cpu::getInstance()->getTCON(), 2, 16, QLatin1Char('0')));
-	ui.pcon->setText(QString("0x%1").arg(cpu::getInstance()->getPCON(), 2, 16, QLatin1Char('0')));
-	ui.dph->setText(QString("0x%1").arg(cpu::getInstance()->getDPH(), 2, 16, QLatin1Char('0')));
-	ui.dpl->setText(QString("0x%1").arg(cpu::getInstance()->getDPL(), 2, 16, QLatin1Char('0')));
-	ui.sp->setText(QString("0x%1").arg(cpu::getInstance()->getSP(), 2, 16, QLatin1Char('0')));
+	ui.b->setText(QString("0x%1").arg(core.getB(), 2, 16, QLatin1Char('0')));
+	ui.acc->setText(QString("0x%1").arg(core.getACC(), 2, 16, QLatin1Char('0')));
+	ui.ip->setText(QString("0x%1").arg(core.getIP(), 2, 16, QLatin1Char('0')));
+	ui.ie->setText(QString("0x%1").arg(core.getIE(), 2, 16, QLatin1Char('0')));
+	ui.tmod->setText(QString("0x%1").arg(core.getTMOD(), 2, 16, QLatin1Char('0')));
+	ui.tcon->setText(QString("0x%1").arg(core.getTCON(), 2, 16, QLatin1Char('0')));
+	ui.pcon->setText(QString("0x%1").arg(core.getPCON(), 2, 16, QLatin1Char('0')));
+	ui.dph->setText(QString("0x%1").arg(core.getDPH(), 2, 16, QLatin1Char('0')));
+	ui.dpl->setText(QString("0x%1").arg(core.getDPL(), 2, 16, QLatin1Char('0')));
+	ui.sp->setText(QString("0x%1").arg(core.getSP(), 2, 16, QLatin1Char('0')));
 
-	ui.pc->setText(QString("0x%1").arg(cpu::getInstance()->getPC(), 4, 16, QLatin1Char('0')));
+	ui.pc->setText(QString("0x%1").arg(core.getPC(), 4, 16, QLatin1Char('0')));
 
-	ui.th0->setText(QString("0x%1").arg(cpu::getInstance()->getTH0(), 2, 16, QLatin1Char('0')));
-	ui.th1->setText(QString("0x%1").arg(cpu::getInstance()->getTH1(), 2, 16, QLatin1Char('0')));
-	ui.tl0->setText(QString("0x%1").arg(cpu::getInstance()->getTL0(), 2, 16, QLatin1Char('0')));
-	ui.tl1->setText(QString("0x%1").arg(cpu::getInstance()->getTL1(), 2, 16, QLatin1Char('0')));
+	ui.th0->setText(QString("0x%1").arg(core.getTH0(), 2, 16, QLatin1Char('0')));
+	ui.th1->setText(QString("0x%1").arg(core.getTH1(), 2, 16, QLatin1Char('0')));
+	ui.tl0->setText(QString("0x%1").arg(core.getTL0(), 2, 16, QLatin1Char('0')));
+	ui.tl1->setText(QString("0x%1").arg(core.getTL1(), 2, 16, QLatin1Char('0')));
 	
-	auto psw = cpu::getInstance()->getPSW();
+	auto psw = core.getPSW();
 	ui.c->setText(QString("%1").arg(((psw >> 7) & 1), 1, 2));
 	ui.ac->setText(QString("%1").arg(((psw >> 6) & 1), 1, 2));
 	ui.f0->setText(QString("%1").arg(((psw >> 5) & 1), 1, 2));
@@ -11,18 +11,21 @@
 class Worker : public QThread {
 	Q_OBJECT
 public:
-	explicit Worker(QObject* parent) : QThread(parent), m_isRunning(false){}
+	explicit Worker(QObject* parent, cpu* core) : QThread(parent), m_core(core), m_isRunning(false){}
 	void run() {
 		m_isRunning = true;
-		cpu::getInstance()->emulateCycle();
+		m_core->emulateCycle();
 	}
 
 	void callback() {
 		emit updateUI();
 	}
 
+	//Returns once emulateCycle() has, so the core can be loaded again or
+	//destroyed without the thread still running from it
 	void stop() {
-		cpu::getInstance()->stopEmulation();
+		m_core->stopEmulation();
+		wait();
 		m_isRunning = false;
 	}
 
@@ -32,6 +35,7 @@ signals:
 	void updateUI();
 
 private:
+	cpu* m_core;
 	bool m_isRunning;
 };
 
@@ -52,6 +56,7 @@ private:
 	Ui::EmulatorUIClass ui;
 	bool isInitialized;
 
+	cpu core;
 	Worker* worker;
 	QThread thread;
 	void startEmulation();
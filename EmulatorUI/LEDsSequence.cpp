@@ -1,9 +1,8 @@
 #include "LEDsSequence.h"
 #include "Constants.h"
-#include "../cpu.h"
 
-LEDsSequence::LEDsSequence(QWidget* parent)
-	: QWidget(parent) {
+LEDsSequence::LEDsSequence(QWidget* parent, cpu* core)
+	: QWidget(parent), core(core) {
 
 	view = new QGraphicsView(this);
 	view->setFixedWidth((diameter + padding) * NUMBER_OF_LEDS + (padding * 2));
@@ -22,7 +21,7 @@ LEDsSequence::LEDsSequence(QWidget* parent)
 
 void LEDsSequence::update() {
 
-	auto p1 = cpu::getInstance()->getP1();
+	auto p1 = core->getP1();
 	for (auto i = 0; i < NUMBER_OF_LEDS; ++i) {
 		if ((p1 >> i) & 0x01) {
 			((QGraphicsEllipseItem*)leds[i])->setBrush(QBrush(EMU_CONSTANTS::green));
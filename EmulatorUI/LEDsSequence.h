@@ -2,6 +2,7 @@
 #include "qwidget.h"
 #include "qgraphicsview.h"
 #include "qgraphicsitem.h"
+#include "../cpu.h"
 
 #define NUMBER_OF_LEDS 8
 
@@ -9,12 +10,13 @@ class LEDsSequence : public QWidget
 {
 	Q_OBJECT
 public:
-	LEDsSequence(QWidget* parent);
+	LEDsSequence(QWidget* parent, cpu* core);
 	~LEDsSequence() {}
 
 private:
 	const qreal diameter = 20;
 	const qreal padding = 5;
+	cpu* core;
 	QGraphicsView* view;
 	QGraphicsEllipseItem* leds[NUMBER_OF_LEDS];
 
@@ -1,75 +1,1221 @@
 #include "cpu.h"
 #include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <climits>
+#include <thread>
 
-cpu* cpu::instance = nullptr;
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <mmsystem.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "winmm.lib")
+#endif
+#endif
 
-cpu* cpu::getInstance()
+//Instruction set description: mnemonic, addressing mode, length in bytes,
+//machine cycles and the handler instantiated for the opcode's operand modes.
+constexpr cpu::instruction_t cpu::isa[OPCODES_SIZE] = {
+	/*00*/ { "NOP", addressing_t::implied, 1, 1, &cpu::op_nop },
+	/*01*/ { "AJMP addr11", addressing_t::absolute, 2, 2, &cpu::op_ajmp<0> },
+	/*02*/ { "LJMP addr16", addressing_t::absolute, 3, 2, &cpu::op_ljmp },
+	/*03*/ { "RR A", addressing_t::acc, 1, 1, &cpu::op_rr },
+	/*04*/ { "INC A", addressing_t::acc, 1, 1, &cpu::op_inc<addressing_t::acc, 0> },
+	/*05*/ { "INC direct", addressing_t::direct, 2, 1, &cpu::op_inc<addressing_t::direct, 0> },
+	/*06*/ { "INC @R0", addressing_t::indirect, 1, 1, &cpu::op_inc<addressing_t::indirect, 0> },
+	/*07*/ { "INC @R1", addressing_t::indirect, 1, 1, &cpu::op_inc<addressing_t::indirect, 1> },
+	/*08*/ { "INC R0", addressing_t::reg, 1, 1, &cpu::op_inc<addressing_t::reg, 0> },
+	/*09*/ { "INC R1", addressing_t::reg, 1, 1, &cpu::op_inc<addressing_t::reg, 1> },
+	/*0A*/ { "INC R2", addressing_t::reg, 1, 1, &cpu::op_inc<addressing_t::reg, 2> },
+	/*0B*/ { "INC R3", addressing_t::reg, 1, 1, &cpu::op_inc<addressing_t::reg, 3> },
+	/*0C*/ { "INC R4", addressing_t::reg, 1, 1, &cpu::op_inc<addressing_t::reg, 4> },
+	/*0D*/ { "INC R5", addressing_t::reg, 1, 1, &cpu::op_inc<addressing_t::reg, 5> },
+	/*0E*/ { "INC R6", addressing_t::reg, 1, 1, &cpu::op_inc<addressing_t::reg, 6> },
+	/*0F*/ { "INC R7", addressing_t::reg, 1, 1, &cpu::op_inc<addressing_t::reg, 7> },
+	/*10*/ { "JBC bit,rel", addressing_t::bit, 3, 2, &cpu::op_jbit<true, true> },
+	/*11*/ { "ACALL addr11", addressing_t::absolute, 2, 2, &cpu::op_acall<0> },
+	/*12*/ { "LCALL addr16", addressing_t::absolute, 3, 2, &cpu::op_lcall },
+	/*13*/ { "RRC A", addressing_t::acc, 1, 1, &cpu::op_rrc },
+	/*14*/ { "DEC A", addressing_t::acc, 1, 1, &cpu::op_dec<addressing_t::acc, 0> },
+	/*15*/ { "DEC direct", addressing_t::direct, 2, 1, &cpu::op_dec<addressing_t::direct, 0> },
+	/*16*/ { "DEC @R0", addressing_t::indirect, 1, 1, &cpu::op_dec<addressing_t::indirect, 0> },
+	/*17*/ { "DEC @R1", addressing_t::indirect, 1, 1, &cpu::op_dec<addressing_t::indirect, 1> },
+	/*18*/ { "DEC R0", addressing_t::reg, 1, 1, &cpu::op_dec<addressing_t::reg, 0> },
+	/*19*/ { "DEC R1", addressing_t::reg, 1, 1, &cpu::op_dec<addressing_t::reg, 1> },
+	/*1A*/ { "DEC R2", addressing_t::reg, 1, 1, &cpu::op_dec<addressing_t::reg, 2> },
+	/*1B*/ { "DEC R3", addressing_t::reg, 1, 1, &cpu::op_dec<addressing_t::reg, 3> },
+	/*1C*/ { "DEC R4", addressing_t::reg, 1, 1, &cpu::op_dec<addressing_t::reg, 4> },
+	/*1D*/ { "DEC R5", addressing_t::reg, 1, 1, &cpu::op_dec<addressing_t::reg, 5> },
+	/*1E*/ { "DEC R6", addressing_t::reg, 1, 1, &cpu::op_dec<addressing_t::reg, 6> },
+	/*1F*/ { "DEC R7", addressing_t::reg, 1, 1, &cpu::op_dec<addressing_t::reg, 7> },
+	/*20*/ { "JB bit,rel", addressing_t::bit, 3, 2, &cpu::op_jbit<true, false> },
+	/*21*/ { "AJMP addr11", addressing_t::absolute, 2, 2, &cpu::op_ajmp<1> },
+	/*22*/ { "RET", addressing_t::implied, 1, 2, &cpu::op_ret },
+	/*23*/ { "RL A", addressing_t::acc, 1, 1, &cpu::op_rl },
+	/*24*/ { "ADD A,#data", addressing_t::immediate, 2, 1, &cpu::op_add<addressing_t::immediate, 0> },
+	/*25*/ { "ADD A,direct", addressing_t::direct, 2, 1, &cpu::op_add<addressing_t::direct, 0> },
+	/*26*/ { "ADD A,@R0", addressing_t::indirect, 1, 1, &cpu::op_add<addressing_t::indirect, 0> },
+	/*27*/ { "ADD A,@R1", addressing_t::indirect, 1, 1, &cpu::op_add<addressing_t::indirect, 1> },
+	/*28*/ { "ADD A,R0", addressing_t::reg, 1, 1, &cpu::op_add<addressing_t::reg, 0> },
+	/*29*/ { "ADD A,R1", addressing_t::reg, 1, 1, &cpu::op_add<addressing_t::reg, 1> },
+	/*2A*/ { "ADD A,R2", addressing_t::reg, 1, 1, &cpu::op_add<addressing_t::reg, 2> },
+	/*2B*/ { "ADD A,R3", addressing_t::reg, 1, 1, &cpu::op_add<addressing_t::reg, 3> },
+	/*2C*/ { "ADD A,R4", addressing_t::reg, 1, 1, &cpu::op_add<addressing_t::reg, 4> },
+	/*2D*/ { "ADD A,R5", addressing_t::reg, 1, 1, &cpu::op_add<addressing_t::reg, 5> },
+	/*2E*/ { "ADD A,R6", addressing_t::reg, 1, 1, &cpu::op_add<addressing_t::reg, 6> },
+	/*2F*/ { "ADD A,R7", addressing_t::reg, 1, 1, &cpu::op_add<addressing_t::reg, 7> },
+	/*30*/ { "JNB bit,rel", addressing_t::bit, 3, 2, &cpu::op_jbit<false, false> },
+	/*31*/ { "ACALL addr11", addressing_t::absolute, 2, 2, &cpu::op_acall<1> },
+	/*32*/ { "RETI", addressing_t::implied, 1, 2, &cpu::op_reti },
+	/*33*/ { "RLC A", addressing_t::acc, 1, 1, &cpu::op_rlc },
+	/*34*/ { "ADDC A,#data", addressing_t::immediate, 2, 1, &cpu::op_addc<addressing_t::immediate, 0> },
+	/*35*/ { "ADDC A,direct", addressing_t::direct, 2, 1, &cpu::op_addc<addressing_t::direct, 0> },
+	/*36*/ { "ADDC A,@R0", addressing_t::indirect, 1, 1, &cpu::op_addc<addressing_t::indirect, 0> },
+	/*37*/ { "ADDC A,@R1", addressing_t::indirect, 1, 1, &cpu::op_addc<addressing_t::indirect, 1> },
+	/*38*/ { "ADDC A,R0", addressing_t::reg, 1, 1, &cpu::op_addc<addressing_t::reg, 0> },
+	/*39*/ { "ADDC A,R1", addressing_t::reg, 1, 1, &cpu::op_addc<addressing_t::reg, 1> },
+	/*3A*/ { "ADDC A,R2", addressing_t::reg, 1, 1, &cpu::op_addc<addressing_t::reg, 2> },
+	/*3B*/ { "ADDC A,R3", addressing_t::reg, 1, 1, &cpu::op_addc<addressing_t::reg, 3> },
+	/*3C*/ { "ADDC A,R4", addressing_t::reg, 1, 1, &cpu::op_addc<addressing_t::reg, 4> },
+	/*3D*/ { "ADDC A,R5", addressing_t::reg, 1, 1, &cpu::op_addc<addressing_t::reg, 5> },
+	/*3E*/ { "ADDC A,R6", addressing_t::reg, 1, 1, &cpu::op_addc<addressing_t::reg, 6> },
+	/*3F*/ { "ADDC A,R7", addressing_t::reg, 1, 1, &cpu::op_addc<addressing_t::reg, 7> },
+	/*40*/ { "JC rel", addressing_t::relative, 2, 2, &cpu::op_jc },
+	/*41*/ { "AJMP addr11", addressing_t::absolute, 2, 2, &cpu::op_ajmp<2> },
+	/*42*/ { "ORL direct,A", addressing_t::direct, 2, 1, &cpu::op_logic<alu_t::orl, addressing_t::direct, addressing_t::acc, 0> },
+	/*43*/ { "ORL direct,#data", addressing_t::immediate, 3, 2, &cpu::op_logic<alu_t::orl, addressing_t::direct, addressing_t::immediate, 0> },
+	/*44*/ { "ORL A,#data", addressing_t::immediate, 2, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::immediate, 0> },
+	/*45*/ { "ORL A,direct", addressing_t::direct, 2, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::direct, 0> },
+	/*46*/ { "ORL A,@R0", addressing_t::indirect, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::indirect, 0> },
+	/*47*/ { "ORL A,@R1", addressing_t::indirect, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::indirect, 1> },
+	/*48*/ { "ORL A,R0", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::reg, 0> },
+	/*49*/ { "ORL A,R1", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::reg, 1> },
+	/*4A*/ { "ORL A,R2", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::reg, 2> },
+	/*4B*/ { "ORL A,R3", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::reg, 3> },
+	/*4C*/ { "ORL A,R4", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::reg, 4> },
+	/*4D*/ { "ORL A,R5", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::reg, 5> },
+	/*4E*/ { "ORL A,R6", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::reg, 6> },
+	/*4F*/ { "ORL A,R7", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::orl, addressing_t::acc, addressing_t::reg, 7> },
+	/*50*/ { "JNC rel", addressing_t::relative, 2, 2, &cpu::op_jnc },
+	/*51*/ { "ACALL addr11", addressing_t::absolute, 2, 2, &cpu::op_acall<2> },
+	/*52*/ { "ANL direct,A", addressing_t::direct, 2, 1, &cpu::op_logic<alu_t::anl, addressing_t::direct, addressing_t::acc, 0> },
+	/*53*/ { "ANL direct,#data", addressing_t::immediate, 3, 2, &cpu::op_logic<alu_t::anl, addressing_t::direct, addressing_t::immediate, 0> },
+	/*54*/ { "ANL A,#data", addressing_t::immediate, 2, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::immediate, 0> },
+	/*55*/ { "ANL A,direct", addressing_t::direct, 2, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::direct, 0> },
+	/*56*/ { "ANL A,@R0", addressing_t::indirect, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::indirect, 0> },
+	/*57*/ { "ANL A,@R1", addressing_t::indirect, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::indirect, 1> },
+	/*58*/ { "ANL A,R0", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::reg, 0> },
+	/*59*/ { "ANL A,R1", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::reg, 1> },
+	/*5A*/ { "ANL A,R2", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::reg, 2> },
+	/*5B*/ { "ANL A,R3", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::reg, 3> },
+	/*5C*/ { "ANL A,R4", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::reg, 4> },
+	/*5D*/ { "ANL A,R5", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::reg, 5> },
+	/*5E*/ { "ANL A,R6", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::reg, 6> },
+	/*5F*/ { "ANL A,R7", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::anl, addressing_t::acc, addressing_t::reg, 7> },
+	/*60*/ { "JZ rel", addressing_t::relative, 2, 2, &cpu::op_jz },
+	/*61*/ { "AJMP addr11", addressing_t::absolute, 2, 2, &cpu::op_ajmp<3> },
+	/*62*/ { "XRL direct,A", addressing_t::direct, 2, 1, &cpu::op_logic<alu_t::xrl, addressing_t::direct, addressing_t::acc, 0> },
+	/*63*/ { "XRL direct,#data", addressing_t::immediate, 3, 2, &cpu::op_logic<alu_t::xrl, addressing_t::direct, addressing_t::immediate, 0> },
+	/*64*/ { "XRL A,#data", addressing_t::immediate, 2, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::immediate, 0> },
+	/*65*/ { "XRL A,direct", addressing_t::direct, 2, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::direct, 0> },
+	/*66*/ { "XRL A,@R0", addressing_t::indirect, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::indirect, 0> },
+	/*67*/ { "XRL A,@R1", addressing_t::indirect, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::indirect, 1> },
+	/*68*/ { "XRL A,R0", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::reg, 0> },
+	/*69*/ { "XRL A,R1", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::reg, 1> },
+	/*6A*/ { "XRL A,R2", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::reg, 2> },
+	/*6B*/ { "XRL A,R3", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::reg, 3> },
+	/*6C*/ { "XRL A,R4", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::reg, 4> },
+	/*6D*/ { "XRL A,R5", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::reg, 5> },
+	/*6E*/ { "XRL A,R6", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::reg, 6> },
+	/*6F*/ { "XRL A,R7", addressing_t::reg, 1, 1, &cpu::op_logic<alu_t::xrl, addressing_t::acc, addressing_t::reg, 7> },
+	/*70*/ { "JNZ rel", addressing_t::relative, 2, 2, &cpu::op_jnz },
+	/*71*/ { "ACALL addr11", addressing_t::absolute, 2, 2, &cpu::op_acall<3> },
+	/*72*/ { "ORL C,bit", addressing_t::bit, 2, 2, &cpu::op_orl_c<false> },
+	/*73*/ { "JMP @A+DPTR", addressing_t::indexed, 1, 2, &cpu::op_jmp },
+	/*74*/ { "MOV A,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::acc, addressing_t::immediate, 0> },
+	/*75*/ { "MOV direct,#data", addressing_t::immediate, 3, 2, &cpu::op_mov<addressing_t::direct, addressing_t::immediate, 0> },
+	/*76*/ { "MOV @R0,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::indirect, addressing_t::immediate, 0> },
+	/*77*/ { "MOV @R1,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::indirect, addressing_t::immediate, 1> },
+	/*78*/ { "MOV R0,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::reg, addressing_t::immediate, 0> },
+	/*79*/ { "MOV R1,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::reg, addressing_t::immediate, 1> },
+	/*7A*/ { "MOV R2,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::reg, addressing_t::immediate, 2> },
+	/*7B*/ { "MOV R3,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::reg, addressing_t::immediate, 3> },
+	/*7C*/ { "MOV R4,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::reg, addressing_t::immediate, 4> },
+	/*7D*/ { "MOV R5,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::reg, addressing_t::immediate, 5> },
+	/*7E*/ { "MOV R6,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::reg, addressing_t::immediate, 6> },
+	/*7F*/ { "MOV R7,#data", addressing_t::immediate, 2, 1, &cpu::op_mov<addressing_t::reg, addressing_t::immediate, 7> },
+	/*80*/ { "SJMP rel", addressing_t::relative, 2, 2, &cpu::op_sjmp },
+	/*81*/ { "AJMP addr11", addressing_t::absolute, 2, 2, &cpu::op_ajmp<4> },
+	/*82*/ { "ANL C,bit", addressing_t::bit, 2, 2, &cpu::op_anl_c<false> },
+	/*83*/ { "MOVC A,@A+PC", addressing_t::indexed, 1, 2, &cpu::op_movc_pc },
+	/*84*/ { "DIV AB", addressing_t::implied, 1, 4, &cpu::op_div },
+	/*85*/ { "MOV direct,direct", addressing_t::direct, 3, 2, &cpu::op_mov<addressing_t::direct, addressing_t::direct, 0> },
+	/*86*/ { "MOV direct,@R0", addressing_t::indirect, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::indirect, 0> },
+	/*87*/ { "MOV direct,@R1", addressing_t::indirect, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::indirect, 1> },
+	/*88*/ { "MOV direct,R0", addressing_t::reg, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::reg, 0> },
+	/*89*/ { "MOV direct,R1", addressing_t::reg, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::reg, 1> },
+	/*8A*/ { "MOV direct,R2", addressing_t::reg, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::reg, 2> },
+	/*8B*/ { "MOV direct,R3", addressing_t::reg, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::reg, 3> },
+	/*8C*/ { "MOV direct,R4", addressing_t::reg, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::reg, 4> },
+	/*8D*/ { "MOV direct,R5", addressing_t::reg, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::reg, 5> },
+	/*8E*/ { "MOV direct,R6", addressing_t::reg, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::reg, 6> },
+	/*8F*/ { "MOV direct,R7", addressing_t::reg, 2, 2, &cpu::op_mov<addressing_t::direct, addressing_t::reg, 7> },
+	/*90*/ { "MOV DPTR,#data16", addressing_t::immediate, 3, 2, &cpu::op_mov_dptr },
+	/*91*/ { "ACALL addr11", addressing_t::absolute, 2, 2, &cpu::op_acall<4> },
+	/*92*/ { "MOV bit,C", addressing_t::bit, 2, 2, &cpu::op_mov_bit_c },
+	/*93*/ { "MOVC A,@A+DPTR", addressing_t::indexed, 1, 2, &cpu::op_movc_dptr },
+	/*94*/ { "SUBB A,#data", addressing_t::immediate, 2, 1, &cpu::op_subb<addressing_t::immediate, 0> },
+	/*95*/ { "SUBB A,direct", addressing_t::direct, 2, 1, &cpu::op_subb<addressing_t::direct, 0> },
+	/*96*/ { "SUBB A,@R0", addressing_t::indirect, 1, 1, &cpu::op_subb<addressing_t::indirect, 0> },
+	/*97*/ { "SUBB A,@R1", addressing_t::indirect, 1, 1, &cpu::op_subb<addressing_t::indirect, 1> },
+	/*98*/ { "SUBB A,R0", addressing_t::reg, 1, 1, &cpu::op_subb<addressing_t::reg, 0> },
+	/*99*/ { "SUBB A,R1", addressing_t::reg, 1, 1, &cpu::op_subb<addressing_t::reg, 1> },
+	/*9A*/ { "SUBB A,R2", addressing_t::reg, 1, 1, &cpu::op_subb<addressing_t::reg, 2> },
+	/*9B*/ { "SUBB A,R3", addressing_t::reg, 1, 1, &cpu::op_subb<addressing_t::reg, 3> },
+	/*9C*/ { "SUBB A,R4", addressing_t::reg, 1, 1, &cpu::op_subb<addressing_t::reg, 4> },
+	/*9D*/ { "SUBB A,R5", addressing_t::reg, 1, 1, &cpu::op_subb<addressing_t::reg, 5> },
+	/*9E*/ { "SUBB A,R6", addressing_t::reg, 1, 1, &cpu::op_subb<addressing_t::reg, 6> },
+	/*9F*/ { "SUBB A,R7", addressing_t::reg, 1, 1, &cpu::op_subb<addressing_t::reg, 7> },
+	/*A0*/ { "ORL C,/bit", addressing_t::bit, 2, 2, &cpu::op_orl_c<true> },
+	/*A1*/ { "AJMP addr11", addressing_t::absolute, 2, 2, &cpu::op_ajmp<5> },
+	/*A2*/ { "MOV C,bit", addressing_t::bit, 2, 1, &cpu::op_mov_c_bit },
+	/*A3*/ { "INC DPTR", addressing_t::implied, 1, 2, &cpu::op_inc_dptr },
+	/*A4*/ { "MUL AB", addressing_t::implied, 1, 4, &cpu::op_mul },
+	/*A5*/ { "reserved", addressing_t::implied, 1, 1, &cpu::op_nop },
+	/*A6*/ { "MOV @R0,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::indirect, addressing_t::direct, 0> },
+	/*A7*/ { "MOV @R1,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::indirect, addressing_t::direct, 1> },
+	/*A8*/ { "MOV R0,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::reg, addressing_t::direct, 0> },
+	/*A9*/ { "MOV R1,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::reg, addressing_t::direct, 1> },
+	/*AA*/ { "MOV R2,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::reg, addressing_t::direct, 2> },
+	/*AB*/ { "MOV R3,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::reg, addressing_t::direct, 3> },
+	/*AC*/ { "MOV R4,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::reg, addressing_t::direct, 4> },
+	/*AD*/ { "MOV R5,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::reg, addressing_t::direct, 5> },
+	/*AE*/ { "MOV R6,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::reg, addressing_t::direct, 6> },
+	/*AF*/ { "MOV R7,direct", addressing_t::direct, 2, 2, &cpu::op_mov<addressing_t::reg, addressing_t::direct, 7> },
+	/*B0*/ { "ANL C,/bit", addressing_t::bit, 2, 2, &cpu::op_anl_c<true> },
+	/*B1*/ { "ACALL addr11", addressing_t::absolute, 2, 2, &cpu::op_acall<5> },
+	/*B2*/ { "CPL bit", addressing_t::bit, 2, 1, &cpu::op_cpl_bit },
+	/*B3*/ { "CPL C", addressing_t::implied, 1, 1, &cpu::op_cpl_c },
+	/*B4*/ { "CJNE A,#data,rel", addressing_t::immediate, 3, 2, &cpu::op_cjne<addressing_t::acc, addressing_t::immediate, 0> },
+	/*B5*/ { "CJNE A,direct,rel", addressing_t::direct, 3, 2, &cpu::op_cjne<addressing_t::acc, addressing_t::direct, 0> },
+	/*B6*/ { "CJNE @R0,#data,rel", addressing_t::indirect, 3, 2, &cpu::op_cjne<addressing_t::indirect, addressing_t::immediate, 0> },
+	/*B7*/ { "CJNE @R1,#data,rel", addressing_t::indirect, 3, 2, &cpu::op_cjne<addressing_t::indirect, addressing_t::immediate, 1> },
+	/*B8*/ { "CJNE R0,#data,rel", addressing_t::reg, 3, 2, &cpu::op_cjne<addressing_t::reg, addressing_t::immediate, 0> },
+	/*B9*/ { "CJNE R1,#data,rel", addressing_t::reg, 3, 2, &cpu::op_cjne<addressing_t::reg, addressing_t::immediate, 1> },
+	/*BA*/ { "CJNE R2,#data,rel", addressing_t::reg, 3, 2, &cpu::op_cjne<addressing_t::reg, addressing_t::immediate, 2> },
+	/*BB*/ { "CJNE R3,#data,rel", addressing_t::reg, 3, 2, &cpu::op_cjne<addressing_t::reg, addressing_t::immediate, 3> },
+	/*BC*/ { "CJNE R4,#data,rel", addressing_t::reg, 3, 2, &cpu::op_cjne<addressing_t::reg, addressing_t::immediate, 4> },
+	/*BD*/ { "CJNE R5,#data,rel", addressing_t::reg, 3, 2, &cpu::op_cjne<addressing_t::reg, addressing_t::immediate, 5> },
+	/*BE*/ { "CJNE R6,#data,rel", addressing_t::reg, 3, 2, &cpu::op_cjne<addressing_t::reg, addressing_t::immediate, 6> },
+	/*BF*/ { "CJNE R7,#data,rel", addressing_t::reg, 3, 2, &cpu::op_cjne<addressing_t::reg, addressing_t::immediate, 7> },
+	/*C0*/ { "PUSH direct", addressing_t::direct, 2, 2, &cpu::op_push },
+	/*C1*/ { "AJMP addr11", addressing_t::absolute, 2, 2, &cpu::op_ajmp<6> },
+	/*C2*/ { "CLR bit", addressing_t::bit, 2, 1, &cpu::op_clr_bit },
+	/*C3*/ { "CLR C", addressing_t::implied, 1, 1, &cpu::op_clr_c },
+	/*C4*/ { "SWAP A", addressing_t::acc, 1, 1, &cpu::op_swap },
+	/*C5*/ { "XCH A,direct", addressing_t::direct, 2, 1, &cpu::op_xch<addressing_t::direct, 0> },
+	/*C6*/ { "XCH A,@R0", addressing_t::indirect, 1, 1, &cpu::op_xch<addressing_t::indirect, 0> },
+	/*C7*/ { "XCH A,@R1", addressing_t::indirect, 1, 1, &cpu::op_xch<addressing_t::indirect, 1> },
+	/*C8*/ { "XCH A,R0", addressing_t::reg, 1, 1, &cpu::op_xch<addressing_t::reg, 0> },
+	/*C9*/ { "XCH A,R1", addressing_t::reg, 1, 1, &cpu::op_xch<addressing_t::reg, 1> },
+	/*CA*/ { "XCH A,R2", addressing_t::reg, 1, 1, &cpu::op_xch<addressing_t::reg, 2> },
+	/*CB*/ { "XCH A,R3", addressing_t::reg, 1, 1, &cpu::op_xch<addressing_t::reg, 3> },
+	/*CC*/ { "XCH A,R4", addressing_t::reg, 1, 1, &cpu::op_xch<addressing_t::reg, 4> },
+	/*CD*/ { "XCH A,R5", addressing_t::reg, 1, 1, &cpu::op_xch<addressing_t::reg, 5> },
+	/*CE*/ { "XCH A,R6", addressing_t::reg, 1, 1, &cpu::op_xch<addressing_t::reg, 6> },
+	/*CF*/ { "XCH A,R7", addressing_t::reg, 1, 1, &cpu::op_xch<addressing_t::reg, 7> },
+	/*D0*/ { "POP direct", addressing_t::direct, 2, 2, &cpu::op_pop },
+	/*D1*/ { "ACALL addr11", addressing_t::absolute, 2, 2, &cpu::op_acall<6> },
+	/*D2*/ { "SETB bit", addressing_t::bit, 2, 1, &cpu::op_setb_bit },
+	/*D3*/ { "SETB C", addressing_t::implied, 1, 1, &cpu::op_setb_c },
+	/*D4*/ { "DA A", addressing_t::acc, 1, 1, &cpu::op_da },
+	/*D5*/ { "DJNZ direct,rel", addressing_t::direct, 3, 2, &cpu::op_djnz<addressing_t::direct, 0> },
+	/*D6*/ { "XCHD A,@R0", addressing_t::indirect, 1, 1, &cpu::op_xchd<0> },
+	/*D7*/ { "XCHD A,@R1", addressing_t::indirect, 1, 1, &cpu::op_xchd<1> },
+	/*D8*/ { "DJNZ R0,rel", addressing_t::reg, 2, 2, &cpu::op_djnz<addressing_t::reg, 0> },
+	/*D9*/ { "DJNZ R1,rel", addressing_t::reg, 2, 2, &cpu::op_djnz<addressing_t::reg, 1> },
+	/*DA*/ { "DJNZ R2,rel", addressing_t::reg, 2, 2, &cpu::op_djnz<addressing_t::reg, 2> },
+	/*DB*/ { "DJNZ R3,rel", addressing_t::reg, 2, 2, &cpu::op_djnz<addressing_t::reg, 3> },
+	/*DC*/ { "DJNZ R4,rel", addressing_t::reg, 2, 2, &cpu::op_djnz<addressing_t::reg, 4> },
+	/*DD*/ { "DJNZ R5,rel", addressing_t::reg, 2, 2, &cpu::op_djnz<addressing_t::reg, 5> },
+	/*DE*/ { "DJNZ R6,rel", addressing_t::reg, 2, 2, &cpu::op_djnz<addressing_t::reg, 6> },
+	/*DF*/ { "DJNZ R7,rel", addressing_t::reg, 2, 2, &cpu::op_djnz<addressing_t::reg, 7> },
+	/*E0*/ { "MOVX A,@DPTR", addressing_t::indexed, 1, 2, &cpu::op_movx<false, addressing_t::indexed, 0> },
+	/*E1*/ { "AJMP addr11", addressing_t::absolute, 2, 2, &cpu::op_ajmp<7> },
+	/*E2*/ { "MOVX A,@R0", addressing_t::indirect, 1, 2, &cpu::op_movx<false, addressing_t::indirect, 0> },
+	/*E3*/ { "MOVX A,@R1", addressing_t::indirect, 1, 2, &cpu::op_movx<false, addressing_t::indirect, 1> },
+	/*E4*/ { "CLR A", addressing_t::acc, 1, 1, &cpu::op_clr_a },
+	/*E5*/ { "MOV A,direct", addressing_t::direct, 2, 1, &cpu::op_mov<addressing_t::acc, addressing_t::direct, 0> },
+	/*E6*/ { "MOV A,@R0", addressing_t::indirect, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::indirect, 0> },
+	/*E7*/ { "MOV A,@R1", addressing_t::indirect, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::indirect, 1> },
+	/*E8*/ { "MOV A,R0", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::reg, 0> },
+	/*E9*/ { "MOV A,R1", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::reg, 1> },
+	/*EA*/ { "MOV A,R2", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::reg, 2> },
+	/*EB*/ { "MOV A,R3", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::reg, 3> },
+	/*EC*/ { "MOV A,R4", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::reg, 4> },
+	/*ED*/ { "MOV A,R5", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::reg, 5> },
+	/*EE*/ { "MOV A,R6", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::reg, 6> },
+	/*EF*/ { "MOV A,R7", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::acc, addressing_t::reg, 7> },
+	/*F0*/ { "MOVX @DPTR,A", addressing_t::indexed, 1, 2, &cpu::op_movx<true, addressing_t::indexed, 0> },
+	/*F1*/ { "ACALL addr11", addressing_t::absolute, 2, 2, &cpu::op_acall<7> },
+	/*F2*/ { "MOVX @R0,A", addressing_t::indirect, 1, 2, &cpu::op_movx<true, addressing_t::indirect, 0> },
+	/*F3*/ { "MOVX @R1,A", addressing_t::indirect, 1, 2, &cpu::op_movx<true, addressing_t::indirect, 1> },
+	/*F4*/ { "CPL A", addressing_t::acc, 1, 1, &cpu::op_cpl_a },
+	/*F5*/ { "MOV direct,A", addressing_t::direct, 2, 1, &cpu::op_mov<addressing_t::direct, addressing_t::acc, 0> },
+	/*F6*/ { "MOV @R0,A", addressing_t::indirect, 1, 1, &cpu::op_mov<addressing_t::indirect, addressing_t::acc, 0> },
+	/*F7*/ { "MOV @R1,A", addressing_t::indirect, 1, 1, &cpu::op_mov<addressing_t::indirect, addressing_t::acc, 1> },
+	/*F8*/ { "MOV R0,A", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::reg, addressing_t::acc, 0> },
+	/*F9*/ { "MOV R1,A", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::reg, addressing_t::acc, 1> },
+	/*FA*/ { "MOV R2,A", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::reg, addressing_t::acc, 2> },
+	/*FB*/ { "MOV R3,A", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::reg, addressing_t::acc, 3> },
+	/*FC*/ { "MOV R4,A", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::reg, addressing_t::acc, 4> },
+	/*FD*/ { "MOV R5,A", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::reg, addressing_t::acc, 5> },
+	/*FE*/ { "MOV R6,A", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::reg, addressing_t::acc, 6> },
+	/*FF*/ { "MOV R7,A", addressing_t::reg, 1, 1, &cpu::op_mov<addressing_t::reg, addressing_t::acc, 7> },
+};
+
+//Superinstructions for the predecoded engine, longest first. Each entry is
+//matched at every address when the ROM is decoded.
+constexpr cpu::fusion_t cpu::fusions[] = {
+	{ { 0xC3, 0xE8, 0x94 }, 3, &cpu::op_fused<0xC3, 0xE8, 0x94> },	//CLR C; MOV A,R0; SUBB A,#data
+	{ { 0xC3, 0xE9, 0x94 }, 3, &cpu::op_fused<0xC3, 0xE9, 0x94> },	//CLR C; MOV A,R1; SUBB A,#data
+	{ { 0xC3, 0xEA, 0x94 }, 3, &cpu::op_fused<0xC3, 0xEA, 0x94> },	//CLR C; MOV A,R2; SUBB A,#data
+	{ { 0xC3, 0xEB, 0x94 }, 3, &cpu::op_fused<0xC3, 0xEB, 0x94> },	//CLR C; MOV A,R3; SUBB A,#data
+	{ { 0xC3, 0xEC, 0x94 }, 3, &cpu::op_fused<0xC3, 0xEC, 0x94> },	//CLR C; MOV A,R4; SUBB A,#data
+	{ { 0xC3, 0xED, 0x94 }, 3, &cpu::op_fused<0xC3, 0xED, 0x94> },	//CLR C; MOV A,R5; SUBB A,#data
+	{ { 0xC3, 0xEE, 0x94 }, 3, &cpu::op_fused<0xC3, 0xEE, 0x94> },	//CLR C; MOV A,R6; SUBB A,#data
+	{ { 0xC3, 0xEF, 0x94 }, 3, &cpu::op_fused<0xC3, 0xEF, 0x94> },	//CLR C; MOV A,R7; SUBB A,#data
+	{ { 0xE8, 0x24 }, 2, &cpu::op_fused<0xE8, 0x24> },	//MOV A,R0; ADD A,#data
+	{ { 0xE9, 0x24 }, 2, &cpu::op_fused<0xE9, 0x24> },	//MOV A,R1; ADD A,#data
+	{ { 0xEA, 0x24 }, 2, &cpu::op_fused<0xEA, 0x24> },	//MOV A,R2; ADD A,#data
+	{ { 0xEB, 0x24 }, 2, &cpu::op_fused<0xEB, 0x24> },	//MOV A,R3; ADD A,#data
+	{ { 0xEC, 0x24 }, 2, &cpu::op_fused<0xEC, 0x24> },	//MOV A,R4; ADD A,#data
+	{ { 0xED, 0x24 }, 2, &cpu::op_fused<0xED, 0x24> },	//MOV A,R5; ADD A,#data
+	{ { 0xEE, 0x24 }, 2, &cpu::op_fused<0xEE, 0x24> },	//MOV A,R6; ADD A,#data
+	{ { 0xEF, 0x24 }, 2, &cpu::op_fused<0xEF, 0x24> },	//MOV A,R7; ADD A,#data
+	{ { 0xE0, 0xA3 }, 2, &cpu::op_fused<0xE0, 0xA3> },	//MOVX A,@DPTR; INC DPTR
+	{ { 0xF0, 0xA3 }, 2, &cpu::op_fused<0xF0, 0xA3> },	//MOVX @DPTR,A; INC DPTR
+	{ { 0xC3, 0x94 }, 2, &cpu::op_fused<0xC3, 0x94> },	//CLR C; SUBB A,#data
+	{ { 0xC3, 0x95 }, 2, &cpu::op_fused<0xC3, 0x95> },	//CLR C; SUBB A,direct
+	{ { 0xC3, 0x98 }, 2, &cpu::op_fused<0xC3, 0x98> },	//CLR C; SUBB A,R0
+	{ { 0xC3, 0x99 }, 2, &cpu::op_fused<0xC3, 0x99> },	//CLR C; SUBB A,R1
+	{ { 0xC3, 0x9A }, 2, &cpu::op_fused<0xC3, 0x9A> },	//CLR C; SUBB A,R2
+	{ { 0xC3, 0x9B }, 2, &cpu::op_fused<0xC3, 0x9B> },	//CLR C; SUBB A,R3
+	{ { 0xC3, 0x9C }, 2, &cpu::op_fused<0xC3, 0x9C> },	//CLR C; SUBB A,R4
+	{ { 0xC3, 0x9D }, 2, &cpu::op_fused<0xC3, 0x9D> },	//CLR C; SUBB A,R5
+	{ { 0xC3, 0x9E }, 2, &cpu::op_fused<0xC3, 0x9E> },	//CLR C; SUBB A,R6
+	{ { 0xC3, 0x9F }, 2, &cpu::op_fused<0xC3, 0x9F> },	//CLR C; SUBB A,R7
+	{ { 0xE4, 0x93 }, 2, &cpu::op_fused<0xE4, 0x93> },	//CLR A; MOVC A,@A+DPTR
+};
+
+cpu::cpu()
 {
-	if (instance == nullptr) {
-		instance = new cpu();
+	timerEvent = addEvent(&cpu::timerOverflow);
+	transmitEvent = addEvent(&cpu::transmitDone);
+	receiveEvent = addEvent(&cpu::receiveDone);
+	for (uchar address : { tcon, tmod, tl0, tl1, th0, th1, scon, sbuf, ie, ip }) {
+		updateSFRHooked(address);
 	}
-	return instance;
+	clear();
+	initOpcodeArray();
+	std::vector<uchar> blank(ROM_SIZE + 2, 0);
+	image = buildImage(blank, 0);
+	adoptImage();
+	hot.sp = stack_start;
+	hot.pc = 0x0000;
 }
 
+//The file is parsed in full before anything is reset, so a core given a
+//file that fails to load keeps running what it had.
 bool cpu::initialize(const std::string& fileName, callBackForEveryCycle_t callback, void* obj)
 {
+	std::vector<uchar> loaded;
+	unsigned int end = 0;
+	if (!readhexfile(fileName, loaded, end)) {
+		return false;
+	}
+	return initialize(buildImage(loaded, end), callback, obj);
+}
+
+bool cpu::initialize(std::shared_ptr<const image_t> shared, callBackForEveryCycle_t callback, void* obj)
+{
+	if (!shared) {
+		std::cerr << "No image to run" << std::endl;
+		return false;
+	}
 	clear();
 	initOpcodeArray();
 	callbackFunc = callback;
 	client = obj;
-	stop = false;
-
-	ram[sp] = stack_start;
-	pc = 0x0000;
-	auto res = readhexfile(fileName);
+	*stop = false;
 
-	return res;
+	hot.sp = stack_start;
+	hot.pc = 0x0000;
+	cycles = 0;
+	image = std::move(shared);
+	adoptImage();
+	return true;
 }
 
+//The callback runs once per emulated second. In real time mode the cycles
+//run in batches of PACING_BATCH_NS of emulated time, and once they are
+//PACING_WINDOW_NS ahead of the host clock one sleep waits for it to catch
+//up. Sleeps overshoot, so the last stretch is spun out instead: at least
+//PACING_SPIN_NS, which assumes sleeps accurate to a fraction of a
+//millisecond as on Linux and macOS, widened to the overshoot measured after
+//each sleep but never over an eighth of the wait or a batch. Windows rounds
+//sleeps up to its timer tick, 15.6 ms by default, so the tick is raised to
+//1 ms for the run. Emulated time is measured from a fixed start so errors do
+//not add up; a host that falls more than PACING_MAX_LAG_NS behind, as under
+//a debugger, starts again from now instead of running flat out to catch up.
 void cpu::emulateCycle()
 {
-	stop = false;
-	long cyclesRemaining = MAX_CYCLES_PER_SECOND;
-	auto start = std::chrono::high_resolution_clock::now();
-	while (!stop) {
-		if (cyclesRemaining > 0) {
-			auto func = opcodeHandler[rom[pc]];
-			++pc;
-			(this->*func)();
-			cyclesRemaining--;
+	typedef std::chrono::steady_clock hostClock_t;
+	unsigned long long perSecond = getCyclesPerSecond();
+	unsigned long long batch = realTime ? std::max<unsigned long long>(perSecond * PACING_BATCH_NS / 1000000000, 1) : perSecond;
+	unsigned long long nextCallback = cycles + perSecond;
+	unsigned long long startCycles = cycles;
+	hostClock_t::time_point start = hostClock_t::now();
+	std::chrono::nanoseconds spin(PACING_SPIN_NS);
+#ifdef _WIN32
+	bool timerRaised = realTime && timeBeginPeriod(1) == TIMERR_NOERROR;
+#endif
+	while (!*stop) {
+		runCycles(std::min(batch, nextCallback - cycles));
+		if (realTime) {
+			unsigned long long elapsed = cycles - startCycles;
+			auto due = start + std::chrono::nanoseconds(elapsed / perSecond * 1000000000 +
+				elapsed % perSecond * 1000000000 / perSecond);
+			auto now = hostClock_t::now();
+			if (now > due + std::chrono::nanoseconds(PACING_MAX_LAG_NS)) {
+				startCycles = cycles;
+				start = now;
+			}
+			else if (due - now >= std::chrono::nanoseconds(PACING_WINDOW_NS)) {
+				//eases back towards PACING_SPIN_NS and covers a quarter more
+				//than the last overshoot, so one late wakeup does not keep
+				//every later wait spinning
+				spin = std::max(spin - spin / 16, std::chrono::nanoseconds(PACING_SPIN_NS));
+				auto wake = due - std::min(spin, std::chrono::duration_cast<std::chrono::nanoseconds>(due - now) / 8);
+				std::this_thread::sleep_until(wake);
+				auto overshoot = std::chrono::duration_cast<std::chrono::nanoseconds>(hostClock_t::now() - wake);
+				spin = std::min(std::max(spin, overshoot + overshoot / 4), std::chrono::nanoseconds(PACING_BATCH_NS));
+				while (hostClock_t::now() < due) {
+				}
+			}
+		}
+		if (cycles >= nextCallback) {
+			nextCallback += perSecond;
+			if (callbackFunc != nullptr) {
+				callbackFunc(client);
+			}
+		}
+	}
+#ifdef _WIN32
+	if (timerRaised) {
+		timeEndPeriod(1);
+	}
+#endif
+	//the request is used up, the next call runs again
+	*stop = false;
+}
+
+//Instructions take one to four machine cycles, so a quarter of what is
+//left can always run without passing the target. The last instruction may
+//end up to three cycles past it since instructions are never split.
+void cpu::runCycles(unsigned long long count)
+{
+	unsigned long long target = cycles + count;
+	while (cycles < target) {
+		unsigned long long left = (target - cycles) / 4;
+		execute(left == 0 ? 1 : (unsigned long)std::min<unsigned long long>(left, ULONG_MAX));
+	}
+}
+
+void cpu::runNanoseconds(unsigned long long nanoseconds)
+{
+	unsigned long long perSecond = getCyclesPerSecond();
+	runCycles(nanoseconds / 1000000000 * perSecond + nanoseconds % 1000000000 * perSecond / 1000000000);
+}
+
+bool cpu::setClock(unsigned long oscillatorHz, unsigned int clocksPerCycle)
+{
+	if (clocksPerCycle == 0 || oscillatorHz < clocksPerCycle) {
+		std::cerr << "Invalid clock " << oscillatorHz << " Hz / " << clocksPerCycle << std::endl;
+		return false;
+	}
+	oscillator = oscillatorHz;
+	clocksPerMachineCycle = clocksPerCycle;
+	return true;
+}
+
+//Emulated time derived from the cycle counter
+unsigned long long cpu::getNanoseconds()
+{
+	unsigned long long perSecond = getCyclesPerSecond();
+	return cycles / perSecond * 1000000000 + cycles % perSecond * 1000000000 / perSecond;
+}
+
+int cpu::addEvent(eventHandler_t* handler, void* context)
+{
+	event_t event;
+	event.handler = handler;
+	event.context = context;
+	events.push_back(event);
+	return (int)events.size() - 1;
+}
+
+int cpu::addEvent(void (cpu::* member)())
+{
+	event_t event;
+	event.member = member;
+	events.push_back(event);
+	return (int)events.size() - 1;
+}
+
+void cpu::scheduleEvent(int id, unsigned long long cycle)
+{
+	events[id].deadline = cycle;
+	eventQueue.emplace_back(cycle, id);
+	std::push_heap(eventQueue.begin(), eventQueue.end(), std::greater<>());
+	nextEvent = std::min(nextEvent, cycle);
+}
+
+//The stale queue entry is left behind and skipped once it is due
+void cpu::cancelEvent(int id)
+{
+	events[id].deadline = never;
+}
+
+//Called by the engines once cycles has reached nextEvent. Handlers may
+//schedule again, including for a cycle that has already passed. A pending
+//interrupt is taken after the events that fall due at this boundary.
+void cpu::runEvents()
+{
+	while (!eventQueue.empty() && eventQueue.front().first <= cycles) {
+		auto entry = eventQueue.front();
+		std::pop_heap(eventQueue.begin(), eventQueue.end(), std::greater<>());
+		eventQueue.pop_back();
+		auto& event = events[entry.second];
+		if (event.deadline != entry.first) {
+			continue;
+		}
+		event.deadline = never;
+		if (event.member != nullptr) {
+			(this->*event.member)();
+		}
+		else {
+			event.handler(event.context);
+		}
+	}
+	if (interruptPending != 0 && cycles >= interruptsFrom) {
+		//events that fall due during the vector's two cycles run before
+		//its first instruction
+		vectorInterrupt();
+		runEvents();
+		return;
+	}
+	nextEvent = eventQueue.empty() ? never : eventQueue.front().first;
+	if (interruptPending != 0) {
+		nextEvent = std::min(nextEvent, interruptsFrom);
+	}
+}
+
+void cpu::execute(unsigned long instructions)
+{
+	//bytes the host sent while the receiver sat idle start a frame
+	if (!isScheduled(receiveEvent) && (sfr[scon - sfr_base] & (scon_ren | scon_ri)) == scon_ren) {
+		scheduleReceive();
+	}
+	if (profile) {
+		executeProfiled(instructions);
+		syncSFR();
+		return;
+	}
+
+	switch (engine) {
+	case engine_t::table:
+		executeTable(instructions);
+		break;
+	case engine_t::threaded:
+		executeThreaded(instructions);
+		break;
+	case engine_t::predecoded:
+		executePredecoded(instructions);
+		break;
+	case engine_t::block:
+	case engine_t::jit:
+		executeBlocks(instructions);
+		break;
+	case engine_t::recompiled:
+		executeRecompiled(instructions);
+		break;
+	}
+	syncSFR();
+}
+
+void cpu::executeTable(unsigned long instructions)
+{
+	while (instructions-- > 0) {
+		uchar opcode = rom[hot.pc];
+		uchar op1 = rom[hot.pc + 1];
+		uchar op2 = rom[hot.pc + 2];
+		hot.pc += isa[opcode].length;
+		cycles += isa[opcode].cycles;
+		(this->*opcodeHandler[opcode])(op1, op2);
+		if (cycles >= nextEvent) {
+			runEvents();
+		}
+	}
+}
+
+//Executes one instruction whose opcode is known at compile time, so the
+//operand fetches and the handler call resolve statically from the isa table.
+//instructions is what is left of the budget after this instruction; an
+//idle loop takes more of it.
+template<uchar OP>
+inline void cpu::step(unsigned long& instructions)
+{
+	constexpr instruction_t instruction = isa[OP];
+	uchar op1 = 0;
+	uchar op2 = 0;
+	if constexpr (instruction.length > 1) {
+		op1 = rom[hot.pc + 1];
+	}
+	if constexpr (instruction.length > 2) {
+		op2 = rom[hot.pc + 2];
+	}
+	if constexpr (isIdleOpcode(OP)) {
+		if (isIdleLoop(hot.pc, OP, op1, op2) && staysIdle(OP, op1)) {
+			instructions -= fastForward(instructions, instruction.cycles);
+		}
+	}
+	if constexpr ((OP & 0xF8) == 0xD8) {
+		if (isDelayLoop(OP, op1)) {
+			instructions -= skipDelay(instructions);
+		}
+	}
+	hot.pc += instruction.length;
+	cycles += instruction.cycles;
+	exec<OP>(op1, op2);
+	if (cycles >= nextEvent) {
+		runEvents();
+	}
+}
+
+//Runs the handler of an opcode known at compile time with operands that
+//are already fetched. Recompiled code calls this with constant operands.
+template<uchar OP>
+inline void cpu::exec(uchar op1, uchar op2)
+{
+	constexpr opcodeHandler_t handler = isa[OP].handler;
+	(this->*handler)(op1, op2);
+}
+
+//Whether an idle loop instruction branches back to itself this time. Bits
+//of an SFR with a read hook are read every iteration, as the hook may be
+//counting on that.
+bool cpu::staysIdle(uchar opcode, uchar op1)
+{
+	switch (opcode) {
+	case 0x20:	//JB
+	case 0x30:	//JNB
+		if (op1 >= 0x80 && sfrHooks[(op1 & 0xF8) - sfr_base].read != nullptr) {
+			return false;
+		}
+		return getBit(op1) == (opcode == 0x20);
+	case 0x40:
+		return PSW_C() != 0;
+	case 0x50:
+		return PSW_C() == 0;
+	case 0x60:
+		return hot.a == 0;
+	case 0x70:
+		return hot.a != 0;
+	default:
+		return true;
+	}
+}
+
+//Accounts for the iterations of an idle loop that end before nextEvent, at
+//most instructions, and returns how many that was. The caller then runs
+//the next iteration as usual: it is the one that can see what changes at
+//the event's cycle, such as a timer flag read before the event has run.
+unsigned long cpu::fastForward(unsigned long instructions, uchar loopCycles)
+{
+	unsigned long long iterations = nextEvent > cycles ? (nextEvent - cycles - 1) / loopCycles : 0;
+	if (iterations > instructions) {
+		iterations = instructions;
+	}
+	cycles += iterations * loopCycles;
+	return (unsigned long)iterations;
+}
+
+//Accounts for the passes of a delay loop at pc that end before nextEvent,
+//at most instructions, and returns how many instructions they were. Like
+//fastForward() it stops short of the last one, leaving Rn at 1 for the
+//caller to run the DJNZ that falls through. From there a pass of the outer
+//loop falls through, decrements Rm, reloads Rn and counts it back down to
+//1, so whole passes of it can be taken the same way while Rm stays above 1.
+unsigned long cpu::skipDelay(unsigned long instructions)
+{
+	uchar opcode = rom[hot.pc];
+	uchar& inner = ram[hot.bank + (opcode & 0x07)];
+	unsigned long long limit = nextEvent > cycles ? nextEvent - cycles - 1 : 0;
+	unsigned long long count = std::min<unsigned long long>({
+		(uchar)(inner - 1), instructions, limit / isa[opcode].cycles });
+	inner -= (uchar)count;
+	cycles += count * isa[opcode].cycles;
+	limit -= count * isa[opcode].cycles;
+	instructions -= (unsigned long)count;
+	if (inner != 1) {
+		return (unsigned long)count;
+	}
+
+	ushort outerAddress = hot.pc + 2;
+	uchar outerOpcode = rom[outerAddress];
+	if ((outerOpcode & 0xF8) != 0xD8 || outerOpcode == opcode) {
+		return (unsigned long)count;
+	}
+	ushort target = outerAddress + 2 + (schar)rom[(ushort)(outerAddress + 1)];
+	ushort reloadAddress = hot.pc - 2;
+	unsigned int reload = 0x100;
+	unsigned int passInstructions = 1;
+	unsigned int passCycles = isa[outerOpcode].cycles;
+	if (target == reloadAddress && rom[reloadAddress] == (0x78 | (opcode & 0x07))) {
+		//MOV Rn,#k, where 0 counts 256 times like the DJNZ does
+		reload = rom[(ushort)(reloadAddress + 1)] != 0 ? rom[(ushort)(reloadAddress + 1)] : 0x100;
+		passInstructions += 1;
+		passCycles += isa[0x78].cycles;
+	}
+	else if (target != hot.pc) {
+		return (unsigned long)count;
+	}
+	passInstructions += reload;
+	passCycles += reload * isa[opcode].cycles;
+
+	uchar& outer = ram[hot.bank + (outerOpcode & 0x07)];
+	unsigned long long passes = std::min<unsigned long long>({
+		(uchar)(outer - 1), instructions / passInstructions, limit / passCycles });
+	outer -= (uchar)passes;
+	cycles += passes * passCycles;
+	return (unsigned long)(count + passes * passInstructions);
+}
+
+//Expands X(00) X(01) ... X(FF) so the threaded engine can name every opcode
+//at compile time instead of going through opcodeHandler.
+#define OPCODE_ROW(X, h) \
+	X(h##0) X(h##1) X(h##2) X(h##3) X(h##4) X(h##5) X(h##6) X(h##7) \
+	X(h##8) X(h##9) X(h##A) X(h##B) X(h##C) X(h##D) X(h##E) X(h##F)
+#define FOR_EACH_OPCODE(X) \
+	OPCODE_ROW(X, 0) OPCODE_ROW(X, 1) OPCODE_ROW(X, 2) OPCODE_ROW(X, 3) \
+	OPCODE_ROW(X, 4) OPCODE_ROW(X, 5) OPCODE_ROW(X, 6) OPCODE_ROW(X, 7) \
+	OPCODE_ROW(X, 8) OPCODE_ROW(X, 9) OPCODE_ROW(X, A) OPCODE_ROW(X, B) \
+	OPCODE_ROW(X, C) OPCODE_ROW(X, D) OPCODE_ROW(X, E) OPCODE_ROW(X, F)
+
+void cpu::executeThreaded(unsigned long instructions)
+{
+#if CPU_USE_COMPUTED_GOTO
+#define OPCODE_LABEL(n) &&label_##n,
+#define OPCODE_BODY(n) label_##n: step<0x##n>(instructions); DISPATCH();
+#define DISPATCH() \
+	if (instructions-- == 0) return; \
+	goto *labels[rom[hot.pc]]
+
+	static void* const labels[OPCODES_SIZE] = { FOR_EACH_OPCODE(OPCODE_LABEL) };
+	DISPATCH();
+	FOR_EACH_OPCODE(OPCODE_BODY)
+
+#undef DISPATCH
+#undef OPCODE_BODY
+#undef OPCODE_LABEL
+#else
+#define OPCODE_CASE(n) case 0x##n: step<0x##n>(instructions); break;
+	while (instructions-- > 0) {
+		switch (rom[hot.pc]) {
+			FOR_EACH_OPCODE(OPCODE_CASE)
+		}
+	}
+#undef OPCODE_CASE
+#endif
+}
+
+//Fused records are only taken while the budget covers every instruction
+//they stand for and no event falls due among them, so the count and the
+//event timing stay exact.
+void cpu::executePredecoded(unsigned long instructions)
+{
+	while (instructions > 0) {
+		//the windows are read again every step since a handler may switch banks
+		decoded_t outside;
+		const decoded_t* instruction;
+		if (hot.pc < decodedEnd) {
+			instruction = fusion ? &fusedWindow[hot.pc] : &decodedWindow[hot.pc];
+		}
+		else {
+			outside = decode(rom, hot.pc);
+			instruction = &outside;
+		}
+		if (instruction->idle && staysIdle(instruction->opcode, instruction->op1)) {
+			instructions -= fastForward(instructions - 1, instruction->cycles);
+		}
+		else if (instruction->delay) {
+			instructions -= skipDelay(instructions - 1);
+		}
+		if (instruction->count > 1 &&
+			(instruction->count > instructions || cycles + instruction->cycles >= nextEvent)) {
+			instruction = &decodedWindow[hot.pc];
+		}
+		hot.pc += instruction->length;
+		cycles += instruction->cycles;
+		(this->*instruction->handler)(instruction->op1, instruction->op2);
+		instructions -= instruction->count;
+		if (cycles >= nextEvent) {
+			runEvents();
+		}
+	}
+}
+
+//The predecoded loop without fusion, counting every opcode and the pair it
+//forms with the one before it
+void cpu::executeProfiled(unsigned long instructions)
+{
+	profile_t& counts = *profile;
+	while (instructions-- > 0) {
+		decoded_t outside;
+		const decoded_t& instruction = hot.pc < decodedEnd ? decodedWindow[hot.pc] : (outside = decode(rom, hot.pc));
+		++counts.opcodes[instruction.opcode];
+		++counts.bigrams[counts.previous * OPCODES_SIZE + instruction.opcode];
+		counts.previous = instruction.opcode;
+		hot.pc += instruction.length;
+		cycles += instruction.cycles;
+		(this->*instruction.handler)(instruction.op1, instruction.op2);
+		if (cycles >= nextEvent) {
+			runEvents();
+		}
+	}
+}
+
+//The record of the instruction at address in one bank's window
+cpu::decoded_t cpu::decode(const uchar* window, ushort address)
+{
+	auto& instruction = isa[window[address]];
+	decoded_t entry;
+	entry.handler = instruction.handler;
+	entry.opcode = window[address];
+	entry.op1 = window[(ushort)(address + 1)];
+	entry.op2 = window[(ushort)(address + 2)];
+	entry.length = instruction.length;
+	entry.cycles = instruction.cycles;
+	entry.idle = isIdleLoop(address, entry.opcode, entry.op1, entry.op2);
+	entry.delay = isDelayLoop(entry.opcode, entry.op1);
+	return entry;
+}
+
+//Decodes every loaded address of every bank up front as if an instruction
+//started there, since code memory is never written once loaded. code is
+//moved into the image.
+std::shared_ptr<const cpu::image_t> cpu::buildImage(std::vector<uchar>& code, unsigned int end)
+{
+	auto built = std::make_shared<image_t>();
+	built->code = std::move(code);
+	code = std::vector<uchar>();
+	built->end = end;
+	//FNV-1a over the loaded part of bank 0 and all of the banks above it
+	built->checksum = 2166136261u;
+	for (unsigned int address = 0; address < end; ++address) {
+		built->checksum = (built->checksum ^ built->code[address]) * 16777619u;
+	}
+	for (size_t address = ROM_SIZE; address + 2 < built->code.size(); ++address) {
+		built->checksum = (built->checksum ^ built->code[address]) * 16777619u;
+	}
+	size_t banks = built->code.size() / ROM_SIZE;
+	built->decoded.resize(banks * end);
+	for (size_t bank = 0; bank < banks; ++bank) {
+		for (unsigned int address = 0; address < end; ++address) {
+			built->decoded[bank * end + address] = decode(&built->code[bank * ROM_SIZE], (ushort)address);
+		}
+	}
+	fuse(*built);
+	return built;
+}
+
+//Points the windows at image and drops the blocks built for the last one
+void cpu::adoptImage()
+{
+	codeEnd = image->end;
+	codeBanks = (unsigned int)(image->code.size() / ROM_SIZE);
+	decodedEnd = image->end;
+	blocks.clear();
+	blocks.resize(image->decoded.size());
+	jitMemory.reset();
+	selectCodeBank(0);
+}
+
+//Copies decoded and replaces every address where a fusions entry starts
+//with one record for the whole sequence. Jumps into the middle of a
+//sequence still find the unfused record of the instruction they land on.
+void cpu::fuse(image_t& image)
+{
+	image.fused = image.decoded;
+	for (size_t base = 0; base < image.decoded.size(); base += image.end) {
+		for (unsigned int address = 0; address < image.end; ++address) {
+			for (auto& sequence : fusions) {
+				unsigned int next = address;
+				uchar operands[2] = { 0, 0 };
+				int operandCount = 0;
+				int cycles = 0;
+				int i = 0;
+				for (; i < sequence.count && next < image.end; ++i) {
+					auto& instruction = image.decoded[base + next];
+					if (instruction.opcode != sequence.opcodes[i]) {
+						break;
+					}
+					if (instruction.length > 1) {
+						operands[operandCount++] = instruction.op1;
+					}
+					if (instruction.length > 2) {
+						operands[operandCount++] = instruction.op2;
+					}
+					cycles += instruction.cycles;
+					next += instruction.length;
+				}
+				if (i < sequence.count || next > ROM_SIZE) {
+					continue;
+				}
+
+				auto& entry = image.fused[base + address];
+				entry.handler = sequence.handler;
+				entry.op1 = operands[0];
+				entry.op2 = operands[1];
+				entry.length = next - address;
+				entry.cycles = cycles;
+				entry.count = sequence.count;
+				break;
+			}
+		}
+	}
+}
+
+//Runs whole blocks while the budget allows, following the successor links
+//so the cache is only consulted when an exit leads somewhere new. The
+//remainder of the budget is single-stepped to keep the count exact, and so
+//is code past the loaded image, which has no blocks. With the jit engine,
+//blocks that have run JIT_THRESHOLD times are translated and blocks the
+//translator rejects keep being interpreted. An event that fell due between
+//runs, like an edge the host drove on an interrupt pin, runs after the
+//first instruction as in the interpreters.
+void cpu::executeBlocks(unsigned long instructions)
+{
+	if (instructions > 0 && cycles >= nextEvent) {
+		executePredecoded(1);
+		--instructions;
+	}
+	block_t* block = lookupBlock(hot.pc);
+	while (instructions > 0 && (block == nullptr || instructions >= block->instructions.size())) {
+		if (block == nullptr) {
+			executePredecoded(1);
+			--instructions;
+			block = lookupBlock(hot.pc);
+			continue;
+		}
+		if (block->idle && staysIdle(block->instructions[0].opcode, block->instructions[0].op1)) {
+			instructions -= fastForward(instructions - 1, (uchar)block->cycles);
+		}
+		else if (block->delay) {
+			instructions -= skipDelay(instructions - 1);
+		}
+		if (cycles + block->cycles >= nextEvent) {
+			//an event falls due within the block, so step up to it
+			if (cycles >= nextEvent) {
+				runEvents();
+			}
+			else {
+				executePredecoded(1);
+				--instructions;
+			}
+			block = lookupBlock(hot.pc);
+			continue;
+		}
+		if (block->native != nullptr && block->bank == hot.bank) {
+			//native code loops over whole passes of the block only, as
+			//many as finish before the next event. No instruction takes
+			//more than four cycles, so most budgets cannot reach it.
+			syncPSW();
+			unsigned long long budget = instructions;
+			if (nextEvent - cycles <= budget * 4) {
+				unsigned long long passes = (nextEvent - cycles - 1) / block->cycles;
+				budget = std::min(budget, passes * block->instructions.size());
+			}
+			jitContext_t context = { ram, xram, &hot, budget };
+			hot.pc = block->native(&context);
+			cycles += (budget - context.budget) / block->instructions.size() * block->cycles;
+			instructions -= (unsigned long)(budget - context.budget);
 		}
 		else {
-			if (cyclesRemaining == 0) {
-				(*(callBackForEveryCycle_t*)callbackFunc)(client);
-				cyclesRemaining = MAX_CYCLES_PER_SECOND;
+			//an SFR access or RETI may bring nextEvent into the block, and a
+			//bank switch leaves the rest of it decoded from the old bank
+			size_t executed = 0;
+			for (auto& instruction : block->instructions) {
+				hot.pc += instruction.length;
+				cycles += instruction.cycles;
+				(this->*instruction.handler)(instruction.op1, instruction.op2);
+				++executed;
+				if (cycles >= nextEvent || codeBank != block->codeBank) {
+					break;
+				}
+			}
+			instructions -= (unsigned long)executed;
+			if (executed < block->instructions.size()) {
+				if (cycles >= nextEvent) {
+					runEvents();
+				}
+				block = lookupBlock(hot.pc);
+				continue;
+			}
+			if (engine == engine_t::jit && ++block->executions == JIT_THRESHOLD) {
+				translateBlock(block);
+			}
+		}
+		block = nextBlock(block);
+	}
+	executePredecoded(instructions);
+}
+
+//The cached block starting at address, built on first use. Blocks end at
+//decodedEnd, and there are none past it.
+cpu::block_t* cpu::lookupBlock(ushort address)
+{
+	if (address >= decodedEnd) {
+		return nullptr;
+	}
+	auto& block = blocksWindow[address];
+	if (block) {
+		return block.get();
+	}
+
+	block = std::make_unique<block_t>();
+	block->start = address;
+	block->codeBank = codeBank;
+	while (true) {
+		auto& instruction = decodedWindow[address];
+		block->instructions.push_back(instruction);
+		block->cycles += instruction.cycles;
+		unsigned int next = address + instruction.length;
+		address = (ushort)next;
+		if (isBranch(instruction.opcode) || next >= decodedEnd ||
+			block->instructions.size() == MAX_BLOCK_LENGTH) {
+			break;
+		}
+	}
+	block->end = address;
+	block->idle = block->instructions.size() == 1 && block->instructions[0].idle;
+	block->delay = block->instructions.size() == 1 && block->instructions[0].delay;
+	return block.get();
+}
+
+cpu::block_t* cpu::nextBlock(block_t* block)
+{
+	for (auto successor : block->successor) {
+		if (successor != nullptr && successor->start == hot.pc && successor->codeBank == codeBank) {
+			return successor;
+		}
+	}
+	auto next = lookupBlock(hot.pc);
+	block->successor[hot.pc == block->end ? 1 : 0] = next;
+	return next;
+}
+
+//Any instruction that can load pc with something other than the next address
+bool cpu::isBranch(uchar opcode)
+{
+	switch (opcode & 0x1F) {
+	case 0x01:	//AJMP
+	case 0x11:	//ACALL
+		return true;
+	}
+	switch (opcode) {
+	case 0x02: case 0x12: case 0x22: case 0x32:	//LJMP, LCALL, RET, RETI
+	case 0x10: case 0x20: case 0x30:		//JBC, JB, JNB
+	case 0x40: case 0x50: case 0x60: case 0x70:	//JC, JNC, JZ, JNZ
+	case 0x80: case 0x73: case 0xD5:		//SJMP, JMP @A+DPTR, DJNZ direct
+	case 0xB4: case 0xB5: case 0xB6: case 0xB7:	//CJNE
+	case 0xB8: case 0xB9: case 0xBA: case 0xBB:
+	case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+	case 0xD8: case 0xD9: case 0xDA: case 0xDB:	//DJNZ Rn
+	case 0xDC: case 0xDD: case 0xDE: case 0xDF:
+		return true;
+	}
+	return false;
+}
+
+//FNV-1a over the loaded part of code memory, used to tie recompiled code
+//to the image it was generated from
+unsigned int cpu::imageChecksum()
+{
+	return image->checksum;
+}
+
+//Profiling replaces the selected engine until it is turned off again.
+//Turning it on starts a fresh set of counts.
+void cpu::setProfiling(bool enabled)
+{
+	if (enabled) {
+		profile = std::make_unique<profile_t>();
+	}
+	else {
+		profile.reset();
+	}
+}
+
+//Ranks opcodes and addressing modes by how often they ran, and opcode pairs
+//by the dispatches fusing them would save: one per execution of a pair the
+//predecoded engine could fuse, none for a pair that is already fused, that
+//starts with a branch or whose operands do not fit in one record. Machine
+//cycles show where emulated time goes.
+void cpu::reportProfile(std::ostream& out, int top)
+{
+	static const char* modeNames[] = { "implied", "acc", "reg", "direct", "indirect",
+		"immediate", "bit", "relative", "absolute", "indexed" };
+	static const char* engineNames[] = { "table", "threaded", "predecoded", "block", "jit", "recompiled" };
+
+	if (!profile) {
+		return;
+	}
+
+	unsigned long long total = 0;
+	unsigned long long totalCycles = 0;
+	unsigned long long modes[sizeof(modeNames) / sizeof(modeNames[0])] = {};
+	std::vector<int> opcodes;
+	for (int opcode = 0; opcode < OPCODES_SIZE; ++opcode) {
+		auto count = profile->opcodes[opcode];
+		if (count != 0) {
+			opcodes.push_back(opcode);
+		}
+		total += count;
+		totalCycles += count * isa[opcode].cycles;
+		modes[(int)isa[opcode].mode] += count;
+	}
+	if (total == 0) {
+		return;
+	}
+
+	auto percent = [](unsigned long long part, unsigned long long whole) {
+		return 100.0 * part / whole;
+	};
+	char line[128];
+
+	out << "counted by the unfused predecoded engine in place of the " << engineNames[(int)engine] <<
+		" engine" << std::endl << std::endl;
+	std::sort(opcodes.begin(), opcodes.end(), [&](int l, int r) {
+		return profile->opcodes[l] > profile->opcodes[r];
+	});
+	out << "opcode\tcount\t\tcycles%\tmnemonic" << std::endl;
+	for (int i = 0; i < (int)opcodes.size() && i < top; ++i) {
+		int opcode = opcodes[i];
+		auto count = profile->opcodes[opcode];
+		snprintf(line, sizeof(line), "%02X\t%-12llu\t%6.2f\t%s", opcode, count,
+			percent(count * isa[opcode].cycles, totalCycles), isa[opcode].mnemonic);
+		out << line << std::endl;
+	}
+
+	out << std::endl << "mode\t\tcount" << std::endl;
+	for (size_t mode = 0; mode < sizeof(modeNames) / sizeof(modeNames[0]); ++mode) {
+		if (modes[mode] != 0) {
+			snprintf(line, sizeof(line), "%-10s\t%llu", modeNames[mode], modes[mode]);
+			out << line << std::endl;
+		}
+	}
+
+	auto blocker = [](int pair) -> const char* {
+		uchar first = pair >> 8;
+		uchar second = pair & 0xFF;
+		for (auto& sequence : fusions) {
+			for (int i = 0; i + 1 < sequence.count; ++i) {
+				if (sequence.opcodes[i] == first && sequence.opcodes[i + 1] == second) {
+					return "fused";
+				}
 			}
-			//auto end = std::chrono::high_resolution_clock::now();
-			//auto duration = std::chrono::duration_cast<std::chrono::seconds>(end - start);
-			//if (duration.count() > 1) {
-			//	cyclesRemaining = MAX_CYCLES_PER_SECOND;
-			//	start = std::chrono::high_resolution_clock::now();
-			//}
+		}
+		if (isBranch(first)) {
+			return "branches";
+		}
+		if (isa[first].length + isa[second].length > 4) {
+			return "operands";
+		}
+		return nullptr;
+	};
+	std::vector<int> bigrams;
+	std::vector<unsigned long long> saved(OPCODES_SIZE * OPCODES_SIZE);
+	for (int pair = 0; pair < OPCODES_SIZE * OPCODES_SIZE; ++pair) {
+		if (profile->bigrams[pair] != 0) {
+			bigrams.push_back(pair);
+			saved[pair] = blocker(pair) == nullptr ? profile->bigrams[pair] : 0;
 		}
 	}
+	std::sort(bigrams.begin(), bigrams.end(), [&](int l, int r) {
+		if (saved[l] != saved[r]) {
+			return saved[l] > saved[r];
+		}
+		return profile->bigrams[l] > profile->bigrams[r];
+	});
+	out << std::endl << "pair\tcount\t\tsaved%\tmnemonics" << std::endl;
+	for (int i = 0; i < (int)bigrams.size() && i < top; ++i) {
+		int pair = bigrams[i];
+		auto count = profile->bigrams[pair];
+		const char* reason = blocker(pair);
+		snprintf(line, sizeof(line), "%02X %02X\t%-12llu\t%6.2f\t%s; %s%s%s%s", pair >> 8, pair & 0xFF, count,
+			percent(saved[pair], total), isa[pair >> 8].mnemonic, isa[pair & 0xFF].mnemonic,
+			reason != nullptr ? " (" : "", reason != nullptr ? reason : "", reason != nullptr ? ")" : "");
+		out << line << std::endl;
+	}
 }
 
 void cpu::dumpPort1()
 {
-	std::cout << std::bitset<8>(ram[p1]) << std::endl;
+	std::cout << std::bitset<8>(sfr[p1 - sfr_base]) << std::endl;
 }
 
 void cpu::stopEmulation()
 {
-	stop = true;
+	*stop = true;
 }
 
 void cpu::clear()
 {
+	hot = registers_t();
+	for (auto& event : events) {
+		event.deadline = never;
+	}
+	eventQueue.clear();
+	nextEvent = never;
 	memset(ram, 0, RAM_SIZE);
-	memset(rom, 0, ROM_SIZE);
+	memset(sfr, 0, SFR_SIZE);
+	//the port latches come out of reset high, so INT0 and INT1 do not hold
+	//back gated timers
+	for (uchar port : { p0, p1, p2, p3 }) {
+		sfr[port - sfr_base] = 0xFF;
+	}
+	updateSFRHooked(p3);
+	timersSynced = 0;
+	transmitting = 0;
+	interruptPending = 0;
+	inService = 0;
+	interruptsFrom = 0;
+	memset(xram, 0, XRAM_SIZE);
 }
 
-bool cpu::readhexfile(const std::string& fileName)
+//Loads a HEX file into code, full 64K banks laid out as image_t::code
+//wants them, and end past the highest address loaded
+bool cpu::readhexfile(const std::string& fileName, std::vector<uchar>& code, unsigned int& end)
 {
 	FILE* fp = fopen(fileName.c_str(), "r");
 	if (fp == nullptr) {
@@ -84,10 +1230,13 @@ bool cpu::readhexfile(const std::string& fileName)
 		return false;
 	}
 
+	code.assign(ROM_SIZE + 2, 0);
+	end = 0;
 	auto currentLine = 0;
 	int memoryLocation = 0;
+	unsigned long extendedAddress = 0;
 	while (currentLine < lines) {
-		auto res = readLineData(fp, memoryLocation);
+		auto res = readLineData(fp, memoryLocation, extendedAddress, code, end);
 		if (!res) {
 			std::cerr << "Failed to read data" << std::endl;
 			fclose(fp);
@@ -95,7 +1244,16 @@ bool cpu::readhexfile(const std::string& fileName)
 		}
 		++currentLine;
 	}
+	fclose(fp);
 
+	//every bank sees the common area as loaded into bank 0, and the last
+	//one is followed by the bytes operand fetches past 0xFFFF wrap around to
+	size_t banks = code.size() / ROM_SIZE;
+	for (size_t bank = 1; bank < banks; ++bank) {
+		std::copy(code.begin(), code.begin() + codeBankWindow, code.begin() + bank * ROM_SIZE);
+	}
+	code[banks * ROM_SIZE] = code[0];
+	code[banks * ROM_SIZE + 1] = code[1];
 	return true;
 }
 
@@ -112,7 +1270,8 @@ int cpu::getNumberofLines(FILE* fp)
 	return lines;
 }
 
-bool cpu::readLineData(FILE* fp, int& memoryLocation)
+bool cpu::readLineData(FILE* fp, int& memoryLocation, unsigned long& extendedAddress,
+	std::vector<uchar>& code, unsigned int& end)
 {
 	//Line Data Breakdown
 	uchar byte_count;
@@ -134,16 +1293,43 @@ bool cpu::readLineData(FILE* fp, int& memoryLocation)
 
 	fulladdress = address1;
 	fulladdress = (fulladdress << 8) | address2;
-	if (fulladdress > ROM_SIZE) {
-		return false;
-	}
 	memoryLocation = fulladdress;
 
+	//extended segment and extended linear address records set the base
+	//of the data records that follow, other record types carry no code
+	if (dataType == 0x02 || dataType == 0x04) {
+		readByte(fp, address1);
+		readByte(fp, address2);
+		extendedAddress = (unsigned long)((address1 << 8) | address2) << (dataType == 0x02 ? 4 : 16);
+		readByte(fp, checkSum);
+		return true;
+	}
+
 	int currentData = 0;
 	while (currentData < byte_count) {
 		readByte(fp, ch);
-		rom[memoryLocation++] = ch;
 		currentData++;
+		if (dataType != 0x00) {
+			continue;
+		}
+
+		//addresses past 64K select a bank, which needs banking configured
+		unsigned long linear = extendedAddress + memoryLocation++;
+		unsigned long bank = linear >> 16;
+		ushort address = linear & 0xFFFF;
+		if (address < codeBankWindow) {
+			bank = 0;
+		}
+		if (bank > (unsigned long)(codeBankMask >> codeBankShift)) {
+			return false;
+		}
+		if ((bank + 1) * ROM_SIZE > code.size()) {
+			code.resize((bank + 1) * ROM_SIZE + 2, 0);
+		}
+		code[bank * ROM_SIZE + address] = ch;
+		if (address >= end) {
+			end = address + 1;
+		}
 	}
 
 	readByte(fp, checkSum);
@@ -190,1654 +1376,916 @@ void cpu::initOpcodeArray()
 {
 	opcodeHandler.clear();
 	opcodeHandler.reserve(OPCODES_SIZE);
-	opcodeHandler.push_back(&cpu::opcode_00);
-	opcodeHandler.push_back(&cpu::opcode_01);
-	opcodeHandler.push_back(&cpu::opcode_02);
-	opcodeHandler.push_back(&cpu::opcode_03);
-	opcodeHandler.push_back(&cpu::opcode_04);
-	opcodeHandler.push_back(&cpu::opcode_05);
-	opcodeHandler.push_back(&cpu::opcode_06);
-	opcodeHandler.push_back(&cpu::opcode_07);
-	opcodeHandler.push_back(&cpu::opcode_08);
-	opcodeHandler.push_back(&cpu::opcode_09);
-	opcodeHandler.push_back(&cpu::opcode_0A);
-	opcodeHandler.push_back(&cpu::opcode_0B);
-	opcodeHandler.push_back(&cpu::opcode_0C);
-	opcodeHandler.push_back(&cpu::opcode_0D);
-	opcodeHandler.push_back(&cpu::opcode_0E);
-	opcodeHandler.push_back(&cpu::opcode_0F);
-	opcodeHandler.push_back(&cpu::opcode_10);
-	opcodeHandler.push_back(&cpu::opcode_11);
-	opcodeHandler.push_back(&cpu::opcode_12);
-	opcodeHandler.push_back(&cpu::opcode_13);
-	opcodeHandler.push_back(&cpu::opcode_14);
-	opcodeHandler.push_back(&cpu::opcode_15);
-	opcodeHandler.push_back(&cpu::opcode_16);
-	opcodeHandler.push_back(&cpu::opcode_17);
-	opcodeHandler.push_back(&cpu::opcode_18);
-	opcodeHandler.push_back(&cpu::opcode_19);
-	opcodeHandler.push_back(&cpu::opcode_1A);
-	opcodeHandler.push_back(&cpu::opcode_1B);
-	opcodeHandler.push_back(&cpu::opcode_1C);
-	opcodeHandler.push_back(&cpu::opcode_1D);
-	opcodeHandler.push_back(&cpu::opcode_1E);
-	opcodeHandler.push_back(&cpu::opcode_1F);
-	opcodeHandler.push_back(&cpu::opcode_20);
-	opcodeHandler.push_back(&cpu::opcode_21);
-	opcodeHandler.push_back(&cpu::opcode_22);
-	opcodeHandler.push_back(&cpu::opcode_23);
-	opcodeHandler.push_back(&cpu::opcode_24);
-	opcodeHandler.push_back(&cpu::opcode_25);
-	opcodeHandler.push_back(&cpu::opcode_26);
-	opcodeHandler.push_back(&cpu::opcode_27);
-	opcodeHandler.push_back(&cpu::opcode_28);
-	opcodeHandler.push_back(&cpu::opcode_29);
-	opcodeHandler.push_back(&cpu::opcode_2A);
-	opcodeHandler.push_back(&cpu::opcode_2B);
-	opcodeHandler.push_back(&cpu::opcode_2C);
-	opcodeHandler.push_back(&cpu::opcode_2D);
-	opcodeHandler.push_back(&cpu::opcode_2E);
-	opcodeHandler.push_back(&cpu::opcode_2F);
-	opcodeHandler.push_back(&cpu::opcode_30);
-	opcodeHandler.push_back(&cpu::opcode_31);
-	opcodeHandler.push_back(&cpu::opcode_32);
-	opcodeHandler.push_back(&cpu::opcode_33);
-	opcodeHandler.push_back(&cpu::opcode_34);
-	opcodeHandler.push_back(&cpu::opcode_35);
-	opcodeHandler.push_back(&cpu::opcode_36);
-	opcodeHandler.push_back(&cpu::opcode_37);
-	opcodeHandler.push_back(&cpu::opcode_38);
-	opcodeHandler.push_back(&cpu::opcode_39);
-	opcodeHandler.push_back(&cpu::opcode_3A);
-	opcodeHandler.push_back(&cpu::opcode_3B);
-	opcodeHandler.push_back(&cpu::opcode_3C);
-	opcodeHandler.push_back(&cpu::opcode_3D);
-	opcodeHandler.push_back(&cpu::opcode_3E);
-	opcodeHandler.push_back(&cpu::opcode_3F);
-	opcodeHandler.push_back(&cpu::opcode_40);
-	opcodeHandler.push_back(&cpu::opcode_41);
-	opcodeHandler.push_back(&cpu::opcode_42);
-	opcodeHandler.push_back(&cpu::opcode_43);
-	opcodeHandler.push_back(&cpu::opcode_44);
-	opcodeHandler.push_back(&cpu::opcode_45);
-	opcodeHandler.push_back(&cpu::opcode_46);
-	opcodeHandler.push_back(&cpu::opcode_47);
-	opcodeHandler.push_back(&cpu::opcode_48);
-	opcodeHandler.push_back(&cpu::opcode_49);
-	opcodeHandler.push_back(&cpu::opcode_4A);
-	opcodeHandler.push_back(&cpu::opcode_4B);
-	opcodeHandler.push_back(&cpu::opcode_4C);
-	opcodeHandler.push_back(&cpu::opcode_4D);
-	opcodeHandler.push_back(&cpu::opcode_4E);
-	opcodeHandler.push_back(&cpu::opcode_4F);
-	opcodeHandler.push_back(&cpu::opcode_50);
-	opcodeHandler.push_back(&cpu::opcode_51);
-	opcodeHandler.push_back(&cpu::opcode_52);
-	opcodeHandler.push_back(&cpu::opcode_53);
-	opcodeHandler.push_back(&cpu::opcode_54);
-	opcodeHandler.push_back(&cpu::opcode_55);
-	opcodeHandler.push_back(&cpu::opcode_56);
-	opcodeHandler.push_back(&cpu::opcode_57);
-	opcodeHandler.push_back(&cpu::opcode_58);
-	opcodeHandler.push_back(&cpu::opcode_59);
-	opcodeHandler.push_back(&cpu::opcode_5A);
-	opcodeHandler.push_back(&cpu::opcode_5B);
-	opcodeHandler.push_back(&cpu::opcode_5C);
-	opcodeHandler.push_back(&cpu::opcode_5D);
-	opcodeHandler.push_back(&cpu::opcode_5E);
-	opcodeHandler.push_back(&cpu::opcode_5F);
-	opcodeHandler.push_back(&cpu::opcode_60);
-	opcodeHandler.push_back(&cpu::opcode_61);
-	opcodeHandler.push_back(&cpu::opcode_62);
-	opcodeHandler.push_back(&cpu::opcode_63);
-	opcodeHandler.push_back(&cpu::opcode_64);
-	opcodeHandler.push_back(&cpu::opcode_65);
-	opcodeHandler.push_back(&cpu::opcode_66);
-	opcodeHandler.push_back(&cpu::opcode_67);
-	opcodeHandler.push_back(&cpu::opcode_68);
-	opcodeHandler.push_back(&cpu::opcode_69);
-	opcodeHandler.push_back(&cpu::opcode_6A);
-	opcodeHandler.push_back(&cpu::opcode_6B);
-	opcodeHandler.push_back(&cpu::opcode_6C);
-	opcodeHandler.push_back(&cpu::opcode_6D);
-	opcodeHandler.push_back(&cpu::opcode_6E);
-	opcodeHandler.push_back(&cpu::opcode_6F);
-	opcodeHandler.push_back(&cpu::opcode_70);
-	opcodeHandler.push_back(&cpu::opcode_71);
-	opcodeHandler.push_back(&cpu::opcode_72);
-	opcodeHandler.push_back(&cpu::opcode_73);
-	opcodeHandler.push_back(&cpu::opcode_74);
-	opcodeHandler.push_back(&cpu::opcode_75);
-	opcodeHandler.push_back(&cpu::opcode_76);
-	opcodeHandler.push_back(&cpu::opcode_77);
-	opcodeHandler.push_back(&cpu::opcode_78);
-	opcodeHandler.push_back(&cpu::opcode_79);
-	opcodeHandler.push_back(&cpu::opcode_7A);
-	opcodeHandler.push_back(&cpu::opcode_7B);
-	opcodeHandler.push_back(&cpu::opcode_7C);
-	opcodeHandler.push_back(&cpu::opcode_7D);
-	opcodeHandler.push_back(&cpu::opcode_7E);
-	opcodeHandler.push_back(&cpu::opcode_7F);
-	opcodeHandler.push_back(&cpu::opcode_80);
-	opcodeHandler.push_back(&cpu::opcode_81);
-	opcodeHandler.push_back(&cpu::opcode_82);
-	opcodeHandler.push_back(&cpu::opcode_83);
-	opcodeHandler.push_back(&cpu::opcode_84);
-	opcodeHandler.push_back(&cpu::opcode_85);
-	opcodeHandler.push_back(&cpu::opcode_86);
-	opcodeHandler.push_back(&cpu::opcode_87);
-	opcodeHandler.push_back(&cpu::opcode_88);
-	opcodeHandler.push_back(&cpu::opcode_89);
-	opcodeHandler.push_back(&cpu::opcode_8A);
-	opcodeHandler.push_back(&cpu::opcode_8B);
-	opcodeHandler.push_back(&cpu::opcode_8C);
-	opcodeHandler.push_back(&cpu::opcode_8D);
-	opcodeHandler.push_back(&cpu::opcode_8E);
-	opcodeHandler.push_back(&cpu::opcode_8F);
-	opcodeHandler.push_back(&cpu::opcode_90);
-	opcodeHandler.push_back(&cpu::opcode_91);
-	opcodeHandler.push_back(&cpu::opcode_92);
-	opcodeHandler.push_back(&cpu::opcode_93);
-	opcodeHandler.push_back(&cpu::opcode_94);
-	opcodeHandler.push_back(&cpu::opcode_95);
-	opcodeHandler.push_back(&cpu::opcode_96);
-	opcodeHandler.push_back(&cpu::opcode_97);
-	opcodeHandler.push_back(&cpu::opcode_98);
-	opcodeHandler.push_back(&cpu::opcode_99);
-	opcodeHandler.push_back(&cpu::opcode_9A);
-	opcodeHandler.push_back(&cpu::opcode_9B);
-	opcodeHandler.push_back(&cpu::opcode_9C);
-	opcodeHandler.push_back(&cpu::opcode_9D);
-	opcodeHandler.push_back(&cpu::opcode_9E);
-	opcodeHandler.push_back(&cpu::opcode_9F);
-	opcodeHandler.push_back(&cpu::opcode_A0);
-	opcodeHandler.push_back(&cpu::opcode_A1);
-	opcodeHandler.push_back(&cpu::opcode_A2);
-	opcodeHandler.push_back(&cpu::opcode_A3);
-	opcodeHandler.push_back(&cpu::opcode_A4);
-	opcodeHandler.push_back(&cpu::opcode_A5);
-	opcodeHandler.push_back(&cpu::opcode_A6);
-	opcodeHandler.push_back(&cpu::opcode_A7);
-	opcodeHandler.push_back(&cpu::opcode_A8);
-	opcodeHandler.push_back(&cpu::opcode_A9);
-	opcodeHandler.push_back(&cpu::opcode_AA);
-	opcodeHandler.push_back(&cpu::opcode_AB);
-	opcodeHandler.push_back(&cpu::opcode_AC);
-	opcodeHandler.push_back(&cpu::opcode_AD);
-	opcodeHandler.push_back(&cpu::opcode_AE);
-	opcodeHandler.push_back(&cpu::opcode_AF);
-	opcodeHandler.push_back(&cpu::opcode_B0);
-	opcodeHandler.push_back(&cpu::opcode_B1);
-	opcodeHandler.push_back(&cpu::opcode_B2);
-	opcodeHandler.push_back(&cpu::opcode_B3);
-	opcodeHandler.push_back(&cpu::opcode_B4);
-	opcodeHandler.push_back(&cpu::opcode_B5);
-	opcodeHandler.push_back(&cpu::opcode_B6);
-	opcodeHandler.push_back(&cpu::opcode_B7);
-	opcodeHandler.push_back(&cpu::opcode_B8);
-	opcodeHandler.push_back(&cpu::opcode_B9);
-	opcodeHandler.push_back(&cpu::opcode_BA);
-	opcodeHandler.push_back(&cpu::opcode_BB);
-	opcodeHandler.push_back(&cpu::opcode_BC);
-	opcodeHandler.push_back(&cpu::opcode_BD);
-	opcodeHandler.push_back(&cpu::opcode_BE);
-	opcodeHandler.push_back(&cpu::opcode_BF);
-	opcodeHandler.push_back(&cpu::opcode_C0);
-	opcodeHandler.push_back(&cpu::opcode_C1);
-	opcodeHandler.push_back(&cpu::opcode_C2);
-	opcodeHandler.push_back(&cpu::opcode_C3);
-	opcodeHandler.push_back(&cpu::opcode_C4);
-	opcodeHandler.push_back(&cpu::opcode_C5);
-	opcodeHandler.push_back(&cpu::opcode_C6);
-	opcodeHandler.push_back(&cpu::opcode_C7);
-	opcodeHandler.push_back(&cpu::opcode_C8);
-	opcodeHandler.push_back(&cpu::opcode_C9);
-	opcodeHandler.push_back(&cpu::opcode_CA);
-	opcodeHandler.push_back(&cpu::opcode_CB);
-	opcodeHandler.push_back(&cpu::opcode_CC);
-	opcodeHandler.push_back(&cpu::opcode_CD);
-	opcodeHandler.push_back(&cpu::opcode_CE);
-	opcodeHandler.push_back(&cpu::opcode_CF);
-	opcodeHandler.push_back(&cpu::opcode_D0);
-	opcodeHandler.push_back(&cpu::opcode_D1);
-	opcodeHandler.push_back(&cpu::opcode_D2);
-	opcodeHandler.push_back(&cpu::opcode_D3);
-	opcodeHandler.push_back(&cpu::opcode_D4);
-	opcodeHandler.push_back(&cpu::opcode_D5);
-	opcodeHandler.push_back(&cpu::opcode_D6);
-	opcodeHandler.push_back(&cpu::opcode_D7);
-	opcodeHandler.push_back(&cpu::opcode_D8);
-	opcodeHandler.push_back(&cpu::opcode_D9);
-	opcodeHandler.push_back(&cpu::opcode_DA);
-	opcodeHandler.push_back(&cpu::opcode_DB);
-	opcodeHandler.push_back(&cpu::opcode_DC);
-	opcodeHandler.push_back(&cpu::opcode_DD);
-	opcodeHandler.push_back(&cpu::opcode_DE);
-	opcodeHandler.push_back(&cpu::opcode_DF);
-	opcodeHandler.push_back(&cpu::opcode_E0);
-	opcodeHandler.push_back(&cpu::opcode_E1);
-	opcodeHandler.push_back(&cpu::opcode_E2);
-	opcodeHandler.push_back(&cpu::opcode_E3);
-	opcodeHandler.push_back(&cpu::opcode_E4);
-	opcodeHandler.push_back(&cpu::opcode_E5);
-	opcodeHandler.push_back(&cpu::opcode_E6);
-	opcodeHandler.push_back(&cpu::opcode_E7);
-	opcodeHandler.push_back(&cpu::opcode_E8);
-	opcodeHandler.push_back(&cpu::opcode_E9);
-	opcodeHandler.push_back(&cpu::opcode_EA);
-	opcodeHandler.push_back(&cpu::opcode_EB);
-	opcodeHandler.push_back(&cpu::opcode_EC);
-	opcodeHandler.push_back(&cpu::opcode_ED);
-	opcodeHandler.push_back(&cpu::opcode_EE);
-	opcodeHandler.push_back(&cpu::opcode_EF);
-	opcodeHandler.push_back(&cpu::opcode_F0);
-	opcodeHandler.push_back(&cpu::opcode_F1);
-	opcodeHandler.push_back(&cpu::opcode_F2);
-	opcodeHandler.push_back(&cpu::opcode_F3);
-	opcodeHandler.push_back(&cpu::opcode_F4);
-	opcodeHandler.push_back(&cpu::opcode_F5);
-	opcodeHandler.push_back(&cpu::opcode_F6);
-	opcodeHandler.push_back(&cpu::opcode_F7);
-	opcodeHandler.push_back(&cpu::opcode_F8);
-	opcodeHandler.push_back(&cpu::opcode_F9);
-	opcodeHandler.push_back(&cpu::opcode_FA);
-	opcodeHandler.push_back(&cpu::opcode_FB);
-	opcodeHandler.push_back(&cpu::opcode_FC);
-	opcodeHandler.push_back(&cpu::opcode_FD);
-	opcodeHandler.push_back(&cpu::opcode_FE);
-	opcodeHandler.push_back(&cpu::opcode_FF);
+	for (auto& instruction : isa) {
+		opcodeHandler.push_back(instruction.handler);
+	}
+}
+
+//Parity of every byte value, 1 when it has an odd number of bits set
+static constexpr struct parityTable_t {
+	uchar odd[256];
+	constexpr parityTable_t() : odd() {
+		for (int value = 0; value < 256; ++value) {
+			odd[value] = (value ^ (value >> 1) ^ (value >> 2) ^ (value >> 3) ^
+				(value >> 4) ^ (value >> 5) ^ (value >> 6) ^ (value >> 7)) & 0x01;
+		}
+	}
+} parity;
+
+//C, AC and OV of a recorded ADD/ADDC or SUBB
+uchar cpu::lazyFlags(flags_t op, uchar a, uchar value, uchar carry)
+{
+	if (op == flags_t::add) {
+		unsigned int result = a + value + carry;
+		return (result > 0xFF ? 0x80 : 0) |
+			((a & 0x0F) + (value & 0x0F) + carry > 0x0F ? 0x40 : 0) |
+			((a ^ result) & (value ^ result) & 0x80 ? 0x04 : 0);
+	}
+	int result = a - value - carry;
+	return (result < 0 ? 0x80 : 0) |
+		((a & 0x0F) - (value & 0x0F) - carry < 0 ? 0x40 : 0) |
+		((a ^ value) & (a ^ result) & 0x80 ? 0x04 : 0);
+}
+
+inline void cpu::syncPSW()
+{
+	if (hot.flagsOp == flags_t::valid) {
+		return;
+	}
+	uchar flags = lazyFlags(hot.flagsOp, hot.flagsA, hot.flagsValue, hot.flagsCarry);
+	hot.psw = (hot.psw & ~(0x80 | 0x40 | 0x04)) | flags;
+	hot.flagsOp = flags_t::valid;
+}
+
+uchar cpu::readPSW()
+{
+	syncPSW();
+	hot.psw = (hot.psw & 0xFE) | parity.odd[hot.a];
+	return hot.psw;
+}
+
+//Works from a copy of hot so one read of each field is all it takes
+uchar cpu::peekPSW() const
+{
+	registers_t state = hot;
+	uchar value = state.psw;
+	if (state.flagsOp != flags_t::valid) {
+		value = (value & ~(0x80 | 0x40 | 0x04)) |
+			lazyFlags(state.flagsOp, state.flagsA, state.flagsValue, state.flagsCarry);
+	}
+	return (value & 0xFE) | parity.odd[state.a];
 }
 
+//Carry is tested by every conditional jump and rotate, so it is worked out
+//from the recorded operation without syncing the other flags.
 uchar cpu::PSW_C()
 {
-	return ram[psw] & 0x80;
+	switch (hot.flagsOp) {
+	case flags_t::add:
+		return hot.flagsA + hot.flagsValue + hot.flagsCarry > 0xFF ? 0x80 : 0x00;
+	case flags_t::subb:
+		return hot.flagsA < hot.flagsValue + hot.flagsCarry ? 0x80 : 0x00;
+	default:
+		return hot.psw & 0x80;
+	}
 }
 
 uchar cpu::PSW_AC()
 {
-	return ram[psw] & 0x40;
+	return readPSW() & 0x40;
 }
 
 uchar cpu::PSW_F0()
 {
-	return ram[psw] & 0x20;
+	return readPSW() & 0x20;
 }
 
 uchar cpu::PSW_RS1()
 {
-	return ram[psw] & 0x10;
+	return readPSW() & 0x10;
 }
 
 uchar cpu::PSW_RS0()
 {
-	return ram[psw] & 0x08;
+	return readPSW() & 0x08;
 }
 
 uchar cpu::PSW_OV()
 {
-	return ram[psw] & 0x04;
+	return readPSW() & 0x04;
 }
 
 uchar cpu::PSW_P()
 {
-	return ram[psw] & 0x01;
+	return readPSW() & 0x01;
 }
 
 void cpu::setPSW_C(uchar b)
 {
+	syncPSW();
 	if (b) {
-		ram[psw] |= 0x80;
+		hot.psw |= 0x80;
 	}
 	else {
-		ram[psw] &= (~0x80);
+		hot.psw &= (~0x80);
 	}
 }
 
 void cpu::setPSW_AC(uchar b)
 {
+	syncPSW();
 	if (b) {
-		ram[psw] |= 0x40;
+		hot.psw |= 0x40;
 	}
 	else {
-		ram[psw] &= (~0x40);
+		hot.psw &= (~0x40);
 	}
 }
 
 void cpu::setPSW_F0(uchar b)
 {
+	syncPSW();
 	if (b) {
-		ram[psw] |= 0x20;
+		hot.psw |= 0x20;
 	}
 	else {
-		ram[psw] &= (~0x20);
+		hot.psw &= (~0x20);
 	}
 }
 
 void cpu::setPSW_RS1(uchar b)
 {
+	syncPSW();
 	if (b) {
-		ram[psw] |= 0x10;
+		hot.psw |= 0x10;
 	}
 	else {
-		ram[psw] &= (~0x10);
+		hot.psw &= (~0x10);
 	}
+	hot.bank = hot.psw & 0x18;
 }
 
 void cpu::setPSW_RS0(uchar b)
 {
+	syncPSW();
 	if (b) {
-		ram[psw] |= 0x08;
+		hot.psw |= 0x08;
 	}
 	else {
-		ram[psw] &= (~0x08);
+		hot.psw &= (~0x08);
 	}
+	hot.bank = hot.psw & 0x18;
 }
 
 void cpu::setPSW_OV(uchar b)
 {
+	syncPSW();
 	if (b) {
-		ram[psw] |= 0x04;
+		hot.psw |= 0x04;
 	}
 	else {
-		ram[psw] &= (~0x04);
+		hot.psw &= (~0x04);
 	}
 }
 
 void cpu::setPSW_P(uchar b)
 {
+	syncPSW();
 	if (b) {
-		ram[psw] |= 0x01;
+		hot.psw |= 0x01;
 	}
 	else {
-		ram[psw] &= (~0x01);
+		hot.psw &= (~0x01);
 	}
 }
 
 ushort cpu::getDPTR()
 {
-	ushort a = ram[dpl];
-	a = (ram[dph] << 8) | a;
-	return a;
+	return hot.dptr;
 }
 
 void cpu::setDPTR(ushort a)
 {
-	ram[dpl] = (uchar)(a & 0x0F);
-	ram[dph] = (uchar)(a >> 8);
+	hot.dptr = a;
 }
 
-//opcode handlers
-void cpu::opcode_00() {}
-void cpu::opcode_01() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	++pc;
-	high >>= 5;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_02() {
-	ushort addr = get16hex(rom, pc);
-	pc = addr;
-}
-void cpu::opcode_03() {
-	auto temp = ram[acc];
-	ram[acc] = ram[acc] >> 1;
-	temp = temp & 0x7F;
-	ram[acc] = ram[acc] | temp;
-}
-void cpu::opcode_04() {
-	ram[acc] += 1;
-}
-void cpu::opcode_05() {
-	ram[rom[pc]] += 1;
-	++pc;
-}
-void cpu::opcode_06() {
-	ram[ram[r0]] += 1;
-}
-void cpu::opcode_07() {
-	ram[ram[r1]] += 1;
-}
-void cpu::opcode_08() {
-	ram[r0] += 1;
-}
-void cpu::opcode_09() {
-	ram[r1] += 1;
-}
-void cpu::opcode_0A() {
-	ram[r2] += 1;
-}
-void cpu::opcode_0B() {
-	ram[r3] += 1;
-}
-void cpu::opcode_0C() {
-	ram[r4] += 1;
-}
-void cpu::opcode_0D() {
-	ram[r5] += 1;
-}
-void cpu::opcode_0E() {
-	ram[r6] += 1;
-}
-void cpu::opcode_0F() {
-	ram[r7] += 1;
-}
-void cpu::opcode_10() {}
-void cpu::opcode_11() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	ushort address = pc;
-	ram[sp]++;
-	ram[ram[sp]] = address & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (address >> 8) & 0xFF;	
-	pc = (high << 8) | low;
-}
-void cpu::opcode_12() {
-	ushort address = (rom[pc] << 8) | rom[pc + 1];
-	pc += 2;
-	ram[sp]++;
-	ram[ram[sp]] = pc & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (pc>>8) & 0xFF;
-	pc = address;
-}
-void cpu::opcode_13() {
-	auto temp = ram[acc] & 0x01;
-	ram[acc] >>= 1;
-	ram[acc] = ram[acc] | (PSW_C());
-	setPSW_C(temp);
-}
-void cpu::opcode_14() {
-	ram[acc] -= 1;
-}
-void cpu::opcode_15() {
-	ram[rom[pc]] -= 1;
-	++pc;
-}
-void cpu::opcode_16() {
-	ram[ram[r0]] -= 1;
-}
-void cpu::opcode_17() {
-	ram[ram[r1]] -= 1;
-}
-void cpu::opcode_18() {
-	ram[r0] -= 1;
-}
-void cpu::opcode_19() {
-	ram[r1] -= 1;
-}
-void cpu::opcode_1A() {
-	ram[r2] -= 1;
-}
-void cpu::opcode_1B() {
-	ram[r3] -= 1;
-}
-void cpu::opcode_1C() {
-	ram[r4] -= 1;
-}
-void cpu::opcode_1D() {
-	ram[r5] -= 1;
-}
-void cpu::opcode_1E() {
-	ram[r6] -= 1;
-}
-void cpu::opcode_1F() {
-	ram[r7] -= 1;
-}
-void cpu::opcode_20() {}
-void cpu::opcode_21() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_22() {
-	ushort address = ram[ram[sp]] << 8;
-	ram[sp]--;
-	address |= ram[ram[sp]];
-	ram[sp]--;
-	pc = address;
-}
-void cpu::opcode_23() {
-	auto temp = ram[acc] & 0x01;
-	ram[acc] <<= 1;
-	ram[acc] |= temp;
-}
-void cpu::opcode_24() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)rom[pc]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (rom[pc] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (rom[pc] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + rom[pc];
-	++pc;
-}
-void cpu::opcode_25() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[pc]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[pc] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[pc] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[pc];
-	++pc;
-}
-void cpu::opcode_26() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[ram[r0]]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[ram[r0]] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[ram[r0]] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[ram[r0]];
-}
-void cpu::opcode_27() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[ram[r1]]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[ram[r1]] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[ram[r1]] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[ram[r1]];
-}
-void cpu::opcode_28() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r0]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r0] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r0] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[r0];
-}
-void cpu::opcode_29() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r1]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r1] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r1] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[r1];
-}
-void cpu::opcode_2A() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r2]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r2] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r2] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[r2];
-}
-void cpu::opcode_2B() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r3]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r3] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r3] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[r3];
-}
-void cpu::opcode_2C() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r4]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r4] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r4] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[r4];
-}
-void cpu::opcode_2D() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r5]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r5] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r5] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[r5];
-}
-void cpu::opcode_2E() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r6]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r6] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r6] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[r6];
-}
-void cpu::opcode_2F() {
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r7]) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r7] & 0x0F)) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r7] & 0x7F)) & 0x80);
-	ram[acc] = ram[acc] + ram[r7];
-}
-void cpu::opcode_30() {}
-void cpu::opcode_31() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	ushort address = pc;
-	ram[sp]++;
-	ram[ram[sp]] = address & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (address >> 8) & 0xFF;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_32() {
-	pc = ram[ram[sp]];
-	ram[sp]--;
-	pc <<= 8;
-	pc |= ram[ram[sp]];
-	ram[sp]--;
-}
-void cpu::opcode_33() {
-	uchar c = PSW_C() ? 1 : 0;
-	auto temp = ram[acc] >> 7;
-	ram[acc] <<= 1;
-	ram[acc] |= c;
-	setPSW_C(temp);
-}
-void cpu::opcode_34() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)rom[pc] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (rom[pc] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (rom[pc] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + rom[pc];
-	++pc;
-}
-void cpu::opcode_35() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[rom[pc]] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[rom[pc]] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[rom[pc]] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[rom[pc]];
-	++pc;
-}
-void cpu::opcode_36() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[ram[r0]] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[ram[r0]] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[ram[r0]] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[ram[r0]];
-}
-void cpu::opcode_37() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[ram[r1]] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[ram[r1]] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[ram[r1]] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[ram[r1]];
-}
-void cpu::opcode_38() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r0] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r0] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r0] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[r0];
-}
-void cpu::opcode_39() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r1] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r1] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r1] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[r1];
-}
-void cpu::opcode_3A() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r2] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r2] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r2] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[r2];
-}
-void cpu::opcode_3B() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r3] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r3] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r3] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[r3];
-}
-void cpu::opcode_3C() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r4] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r4] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r4] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[r4];
-}
-void cpu::opcode_3D() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r5] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r5] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r5] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[r5];
-}
-void cpu::opcode_3E() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r6] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r6] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r6] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[r6];
-}
-void cpu::opcode_3F() {
-	int c = (PSW_C() ? 1 : 0);
-	setPSW_C(((unsigned int)ram[acc] + (unsigned int)ram[r7] + (unsigned int)c) > 255);
-	setPSW_AC(((ram[acc] & 0x0F) + (ram[r7] & 0x0F) + c) & 0xF0);
-	setPSW_OV(((ram[acc] & 0x7F) + (ram[r7] & 0x7F) + c) & 0x80);
-	ram[acc] = ram[acc] + ram[r7];
-}
-void cpu::opcode_40() {
-	schar offset = (schar)rom[pc++];
-	if ((PSW_C() >> 7) == 1)
-		pc += offset;
-}
-void cpu::opcode_41() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	++pc;
-	high >>= 5;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_42() {
-	ram[rom[pc]] |= ram[acc];
-	++pc;
-}
-void cpu::opcode_43() {
-	ram[rom[pc]] |= rom[pc+1];
-	pc += 2;
-}
-void cpu::opcode_44() {
-	ram[acc] |= rom[pc + 1];
-	pc += 1;
-}
-void cpu::opcode_45() {
-	ram[acc] |= ram[rom[pc + 1]];
-	pc += 1;
-}
-void cpu::opcode_46() {
-	ram[acc] |= ram[ram[r0]];
-}
-void cpu::opcode_47() {
-	ram[acc] |= ram[ram[r1]];
-}
-void cpu::opcode_48() {
-	ram[acc] |= ram[r0];
-}
-void cpu::opcode_49() {
-	ram[acc] |= ram[r1];
-}
-void cpu::opcode_4A() {
-	ram[acc] |= ram[r2];
-}
-void cpu::opcode_4B() {
-	ram[acc] |= ram[r3];
-}
-void cpu::opcode_4C() {
-	ram[acc] |= ram[r4];
-}
-void cpu::opcode_4D() {
-	ram[acc] |= ram[r5];
-}
-void cpu::opcode_4E() {
-	ram[acc] |= ram[r6];
-}
-void cpu::opcode_4F() {
-	ram[acc] |= ram[r7];
-}
-void cpu::opcode_50() {
-	schar offset = (schar)rom[pc++];
-	if (PSW_C() == 0)
-		pc += offset;
-}
-void cpu::opcode_51() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	ushort address = pc;
-	ram[sp]++;
-	ram[ram[sp]] = address & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (address >> 8) & 0xFF;
-	pc = (high << 8) | low;
+//SFR access by address, for the registers held in hot
+uchar cpu::readSFR(uchar address)
+{
+	switch (address) {
+	case acc:
+		return hot.a;
+	case psw:
+		return readPSW();
+	case sp:
+		return hot.sp;
+	case dpl:
+		return hot.dptr & 0xFF;
+	case dph:
+		return hot.dptr >> 8;
+	default:
+		if (isHooked(sfrReadHooked, address)) {
+			return readHooked(address);
+		}
+		return sfr[address - sfr_base];
+	}
 }
-void cpu::opcode_52() {
-	ram[rom[pc]] &= ram[acc];
-	++pc;
+
+void cpu::writeSFR(uchar address, uchar value)
+{
+	switch (address) {
+	case acc:
+		hot.a = value;
+		break;
+	case psw:
+		hot.flagsOp = flags_t::valid;
+		hot.psw = value;
+		hot.bank = value & 0x18;
+		break;
+	case sp:
+		hot.sp = value;
+		break;
+	case dpl:
+		hot.dptr = (hot.dptr & 0xFF00) | value;
+		break;
+	case dph:
+		hot.dptr = (hot.dptr & 0x00FF) | (value << 8);
+		break;
+	default:
+		if (isHooked(sfrWriteHooked, address)) {
+			writeHooked(address, value);
+		}
+		else {
+			sfr[address - sfr_base] = value;
+		}
+		break;
+	}
 }
-void cpu::opcode_53() {
-	ram[rom[pc]] &= rom[pc + 1];
-	pc += 2;
-}
-void cpu::opcode_54() {
-	ram[acc] &= rom[pc + 1];
-	pc += 1;
-}
-void cpu::opcode_55() {
-	ram[acc] &= ram[rom[pc + 1]];
-	pc += 1;
+
+//SFRs the cpu maintains lazily are brought up to date before they are
+//accessed
+void cpu::catchUp(uchar address)
+{
+	if (isTimerSFR(address) || address == p3) {
+		syncTimers();
+	}
 }
-void cpu::opcode_56() {
-	ram[acc] &= ram[ram[r0]];
+
+uchar cpu::readHooked(uchar address)
+{
+	catchUp(address);
+	uchar value = sfr[address - sfr_base];
+	auto& hook = sfrHooks[address - sfr_base];
+	if (hook.read != nullptr) {
+		value = hook.read(hook.readContext, address, value);
+	}
+	return value;
 }
-void cpu::opcode_57() {
-	ram[acc] &= ram[ram[r1]];
+
+//SBUF is two registers: writes go to the transmitter and leave the receive
+//buffer that reads return alone
+void cpu::writeHooked(uchar address, uchar value)
+{
+	catchUp(address);
+	if (address == sbuf) {
+		startTransmit(value);
+	}
+	else {
+		sfr[address - sfr_base] = value;
+	}
+	if (address == scon) {
+		scheduleReceive();
+	}
+	if (address == codeBankSelect) {
+		selectCodeBank((value & codeBankMask) >> codeBankShift);
+	}
+	if (isTimerSFR(address) || address == p3) {
+		if (address == tmod) {
+			updateSFRHooked(p3);
+		}
+		scheduleTimers();
+	}
+	if (isInterruptSFR(address)) {
+		if (address == ie || address == ip) {
+			interruptsFrom = cycles + 1;
+		}
+		updateInterrupts();
+	}
+	auto& hook = sfrHooks[address - sfr_base];
+	if (hook.write != nullptr) {
+		hook.write(hook.writeContext, address, value);
+	}
 }
-void cpu::opcode_58() {
-	ram[acc] &= ram[r0];
+
+void cpu::setSFRReadHook(uchar address, sfrReadHook_t* hook, void* context)
+{
+	if (address < sfr_base || isHotSFR(address)) {
+		return;
+	}
+	sfrHooks[address - sfr_base].read = hook;
+	sfrHooks[address - sfr_base].readContext = context;
+	updateSFRHooked(address);
 }
-void cpu::opcode_59() {
-	ram[acc] &= ram[r1];
+
+void cpu::setSFRWriteHook(uchar address, sfrWriteHook_t* hook, void* context)
+{
+	if (address < sfr_base || isHotSFR(address)) {
+		return;
+	}
+	sfrHooks[address - sfr_base].write = hook;
+	sfrHooks[address - sfr_base].writeContext = context;
+	updateSFRHooked(address);
 }
-void cpu::opcode_5A() {
-	ram[acc] &= ram[r2];
+
+//SFRs the cpu itself reacts to take the same path as hooked ones: the
+//timer registers, the interrupt control registers, SBUF, the code bank
+//select register and, while a timer is gated, P3 with the INT0 and INT1 pins.
+void cpu::updateSFRHooked(uchar address)
+{
+	uchar index = address - sfr_base;
+	unsigned long long bit = 1ull << (index & 63);
+	auto& hook = sfrHooks[index];
+	sfrReadHooked[index >> 6] &= ~bit;
+	sfrWriteHooked[index >> 6] &= ~bit;
+	if (hook.read != nullptr || isTimerSFR(address)) {
+		sfrReadHooked[index >> 6] |= bit;
+	}
+	if (hook.write != nullptr || isTimerSFR(address) || isInterruptSFR(address) ||
+		address == sbuf || address == codeBankSelect ||
+		(address == p3 && (sfr[tmod - sfr_base] & 0x88) != 0)) {
+		sfrWriteHooked[index >> 6] |= bit;
+	}
 }
-void cpu::opcode_5B() {
-	ram[acc] &= ram[r3];
+
+void cpu::setCodeBanking(uchar selectAddress, uchar mask, ushort windowStart)
+{
+	if (selectAddress < sfr_base || isHotSFR(selectAddress) || mask == 0) {
+		return;
+	}
+	uchar previous = codeBankSelect;
+	codeBankSelect = selectAddress;
+	codeBankMask = mask;
+	codeBankWindow = windowStart;
+	for (codeBankShift = 0; ((mask >> codeBankShift) & 1) == 0; ++codeBankShift) {
+	}
+	if (previous != 0) {
+		updateSFRHooked(previous);
+	}
+	updateSFRHooked(selectAddress);
 }
-void cpu::opcode_5C() {
-	ram[acc] &= ram[r4];
+
+//Banks past the end of the image wrap around like unconnected address lines
+void cpu::selectCodeBank(unsigned int bank)
+{
+	bank %= codeBanks;
+	size_t base = (size_t)bank * ROM_SIZE;
+	rom = &image->code[base];
+	decodedWindow = image->decoded.data() + (size_t)bank * decodedEnd;
+	fusedWindow = image->fused.data() + (size_t)bank * decodedEnd;
+	blocksWindow = blocks.data() + (size_t)bank * decodedEnd;
+	codeBank = bank;
 }
-void cpu::opcode_5D() {
-	ram[acc] &= ram[r5];
+
+//Leaves the SFR image in sfr matching hot, for anything that reads ram
+//directly between runs
+void cpu::syncSFR()
+{
+	sfr[acc - sfr_base] = hot.a;
+	sfr[psw - sfr_base] = readPSW();
+	sfr[sp - sfr_base] = hot.sp;
+	sfr[dpl - sfr_base] = hot.dptr & 0xFF;
+	sfr[dph - sfr_base] = hot.dptr >> 8;
 }
-void cpu::opcode_5E() {
-	ram[acc] &= ram[r6];
+
+//operand access
+template<cpu::addressing_t M, uchar N>
+inline uchar cpu::load(uchar operand)
+{
+	if constexpr (M == addressing_t::acc) {
+		return hot.a;
+	}
+	else if constexpr (M == addressing_t::reg) {
+		return ram[hot.bank + N];
+	}
+	else if constexpr (M == addressing_t::direct) {
+		if (operand >= 0x80) {
+			return readSFR(operand);
+		}
+		return ram[operand];
+	}
+	else if constexpr (M == addressing_t::indirect) {
+		return ram[ram[hot.bank + N]];
+	}
+	else {
+		static_assert(M == addressing_t::immediate, "operand mode cannot be read");
+		return operand;
+	}
 }
-void cpu::opcode_5F() {
-	ram[acc] &= ram[r7];
+
+template<cpu::addressing_t M, uchar N>
+inline void cpu::store(uchar operand, uchar value)
+{
+	if constexpr (M == addressing_t::acc) {
+		hot.a = value;
+	}
+	else if constexpr (M == addressing_t::reg) {
+		ram[hot.bank + N] = value;
+	}
+	else if constexpr (M == addressing_t::direct) {
+		if (operand >= 0x80) {
+			writeSFR(operand, value);
+		}
+		else {
+			ram[operand] = value;
+		}
+	}
+	else {
+		static_assert(M == addressing_t::indirect, "operand mode cannot be written");
+		ram[ram[hot.bank + N]] = value;
+	}
 }
-void cpu::opcode_60() {
-	schar offset = (schar)rom[pc++];
-	if (ram[acc] == 0)
-		pc += offset;
+
+//Byte address and mask of every bit address. 0x00-0x7F map to RAM
+//0x20-0x2F, 0x80-0xFF to the SFRs whose address is a multiple of 8.
+static constexpr struct bitTable_t {
+	struct {
+		uchar address;
+		uchar mask;
+	} at[256];
+	constexpr bitTable_t() : at() {
+		for (int bit = 0; bit < 256; ++bit) {
+			at[bit].address = bit < 0x80 ? 0x20 + (bit >> 3) : bit & 0xF8;
+			at[bit].mask = 1 << (bit & 0x07);
+		}
+	}
+} bits;
+
+bool cpu::getBit(uchar bit)
+{
+	auto& target = bits.at[bit];
+	uchar byte = bit < 0x80 ? ram[target.address] : readSFR(target.address);
+	return (byte & target.mask) != 0;
 }
-void cpu::opcode_61() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	++pc;
-	high >>= 5;
-	pc = (high << 8) | low;
+
+//Bit writes are read-modify-write on the SFR latch, so a read hook that
+//presents something else, such as port pin levels, is bypassed. The
+//write itself reaches the SFR's write hook.
+void cpu::setBit(uchar bit, bool value)
+{
+	auto& target = bits.at[bit];
+	if (bit < 0x80) {
+		uchar& byte = ram[target.address];
+		byte = (byte & ~target.mask) | (value ? target.mask : 0);
+		return;
+	}
+	uchar byte;
+	if (isHooked(sfrReadHooked, target.address)) {
+		catchUp(target.address);
+		byte = sfr[target.address - sfr_base];
+	}
+	else {
+		byte = readSFR(target.address);
+	}
+	writeSFR(target.address, (byte & ~target.mask) | (value ? target.mask : 0));
 }
-void cpu::opcode_62() {
-	ram[rom[pc]] ^= ram[acc];
-	++pc;
+
+void cpu::push(uchar value)
+{
+	hot.sp++;
+	ram[hot.sp] = value;
 }
-void cpu::opcode_63() {
-	ram[rom[pc]] ^= rom[pc + 1];
-	pc += 2;
+
+uchar cpu::pop()
+{
+	uchar value = ram[hot.sp];
+	hot.sp--;
+	return value;
 }
-void cpu::opcode_64() {
-	ram[acc] ^= rom[pc];
-	pc += 1;
+
+void cpu::add(uchar value, uchar carry)
+{
+	hot.flagsOp = flags_t::add;
+	hot.flagsA = hot.a;
+	hot.flagsValue = value;
+	hot.flagsCarry = carry;
+	hot.a = hot.flagsA + value + carry;
 }
-void cpu::opcode_65() {
-	ram[acc] ^= ram[rom[pc + 1]];
-	pc += 1;
+
+void cpu::subb(uchar value, uchar carry)
+{
+	hot.flagsOp = flags_t::subb;
+	hot.flagsA = hot.a;
+	hot.flagsValue = value;
+	hot.flagsCarry = carry;
+	hot.a = hot.flagsA - value - carry;
 }
-void cpu::opcode_66() {
-	ram[acc] ^= ram[ram[r0]];
+
+//Runs one part of a fused sequence with pc set as if it had been fetched
+//on its own, then hands the operand bytes it did not use to the next part.
+template<uchar OP, uchar... REST>
+inline void cpu::stepFused(uchar op1, uchar op2)
+{
+	constexpr uchar length = isa[OP].length;
+	hot.pc += length;
+	exec<OP>(op1, op2);
+	if constexpr (sizeof...(REST) > 0) {
+		if constexpr (length == 1) {
+			stepFused<REST...>(op1, op2);
+		}
+		else if constexpr (length == 2) {
+			stepFused<REST...>(op2, 0);
+		}
+		else {
+			stepFused<REST...>(0, 0);
+		}
+	}
 }
-void cpu::opcode_67() {
-	ram[acc] ^= ram[ram[r1]];
+
+//pc arrives past the whole sequence and is wound back to its start so each
+//part sees the same pc as when run unfused.
+template<uchar... OPS>
+void cpu::op_fused(uchar op1, uchar op2)
+{
+	static_assert(((isa[OPS].length - 1) + ...) <= 2, "fused operands must fit op1 and op2");
+	hot.pc -= (isa[OPS].length + ...);
+	stepFused<OPS...>(op1, op2);
 }
-void cpu::opcode_68() {
-	ram[acc] ^= ram[r0];
+
+//opcode handlers
+void cpu::op_nop(uchar, uchar) {}
+
+template<uchar PAGE>
+void cpu::op_ajmp(uchar op1, uchar)
+{
+	hot.pc = (hot.pc & 0xF800) | (PAGE << 8) | op1;
 }
-void cpu::opcode_69() {
-	ram[acc] ^= ram[r1];
+
+template<uchar PAGE>
+void cpu::op_acall(uchar op1, uchar)
+{
+	push(hot.pc & 0xFF);
+	push(hot.pc >> 8);
+	hot.pc = (hot.pc & 0xF800) | (PAGE << 8) | op1;
 }
-void cpu::opcode_6A() {
-	ram[acc] ^= ram[r2];
+
+void cpu::op_ljmp(uchar op1, uchar op2)
+{
+	hot.pc = (op1 << 8) | op2;
 }
-void cpu::opcode_6B() {
-	ram[acc] ^= ram[r3];
+
+void cpu::op_lcall(uchar op1, uchar op2)
+{
+	push(hot.pc & 0xFF);
+	push(hot.pc >> 8);
+	hot.pc = (op1 << 8) | op2;
 }
-void cpu::opcode_6C() {
-	ram[acc] ^= ram[r4];
+
+void cpu::op_ret(uchar, uchar)
+{
+	hot.pc = pop() << 8;
+	hot.pc |= pop();
 }
-void cpu::opcode_6D() {
-	ram[acc] ^= ram[r5];
+
+//Ends the highest priority level in service
+void cpu::op_reti(uchar, uchar)
+{
+	hot.pc = pop() << 8;
+	hot.pc |= pop();
+	inService &= (inService & 2) ? 1 : 0;
+	interruptsFrom = cycles + 1;
+	updateInterrupts();
 }
-void cpu::opcode_6E() {
-	ram[acc] ^= ram[r6];
+
+void cpu::op_sjmp(uchar op1, uchar)
+{
+	hot.pc += (schar)op1;
 }
-void cpu::opcode_6F() {
-	ram[acc] ^= ram[r7];
+
+void cpu::op_jmp(uchar, uchar)
+{
+	hot.pc = hot.a + getDPTR();
 }
-void cpu::opcode_70() {
-	pc++;
-	if (ram[acc] != 0) {
-		pc = pc + (schar)rom[pc - 1];
+
+void cpu::op_jc(uchar op1, uchar)
+{
+	if (PSW_C()) {
+		hot.pc += (schar)op1;
 	}
 }
-void cpu::opcode_71() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	ushort address = pc;
-	ram[sp]++;
-	ram[ram[sp]] = address & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (address >> 8) & 0xFF;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_72() {}
-void cpu::opcode_73() {
-	pc = ram[acc] + getDPTR();
-}
-void cpu::opcode_74() {
-	ram[acc] = rom[pc];
-	++pc;
-}
-void cpu::opcode_75() {
-	auto direct = rom[pc++];
-	ram[direct] = rom[pc++];
+
+void cpu::op_jnc(uchar op1, uchar)
+{
+	if (!PSW_C()) {
+		hot.pc += (schar)op1;
+	}
 }
-void cpu::opcode_76() {
-	ram[ram[r0]] = rom[pc];
-	++pc;
+
+void cpu::op_jz(uchar op1, uchar)
+{
+	if (hot.a == 0) {
+		hot.pc += (schar)op1;
+	}
 }
-void cpu::opcode_77() {
-	ram[ram[r1]] = rom[pc];
-	++pc;
-}
-void cpu::opcode_78() {
-	ram[r0] = rom[pc++];
-}
-void cpu::opcode_79() {
-	ram[r1] = rom[pc++];
-}
-void cpu::opcode_7A() {
-	ram[r2] = rom[pc++];
-}
-void cpu::opcode_7B() {
-	ram[r3] = rom[pc++];
-}
-void cpu::opcode_7C() {
-	ram[r4] = rom[pc++];
-}
-void cpu::opcode_7D() {
-	ram[r5] = rom[pc++];
-}
-void cpu::opcode_7E() {
-	ram[r6] = rom[pc++];
-}
-void cpu::opcode_7F() {
-	ram[r7] = rom[pc++];
-}
-void cpu::opcode_80() {
-	schar rel = (schar)rom[pc];
-	pc++;
-	pc = pc + rel;
-}
-void cpu::opcode_81() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	++pc;
-	high >>= 5;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_82() {}
-void cpu::opcode_83() {
-	++pc;
-	ram[acc] = rom[ram[acc] + pc];
-}
-void cpu::opcode_84() {}
-void cpu::opcode_85() {
-	ram[pc] = ram[pc + 1];
-	pc += 2;
-}
-void cpu::opcode_86() {
-	ram[pc] = ram[ram[r0]];
-	pc += 1;
-}
-void cpu::opcode_87() {
-	ram[pc] = ram[ram[r1]];
-	pc += 1;
-}
-void cpu::opcode_88() {
-	ram[pc] = ram[r0];
-	pc += 1;
-}
-void cpu::opcode_89() {
-	ram[pc] = ram[r1];
-	pc += 1;
-}
-void cpu::opcode_8A() {
-	ram[pc] = ram[r2];
-	pc += 1;
-}
-void cpu::opcode_8B() {
-	ram[pc] = ram[r3];
-	pc += 1;
-}
-void cpu::opcode_8C() {
-	ram[pc] = ram[r4];
-	pc += 1;
-}
-void cpu::opcode_8D() {
-	ram[pc] = ram[r5];
-	pc += 1;
-}
-void cpu::opcode_8E() {
-	ram[pc] = ram[r6];
-	pc += 1;
-}
-void cpu::opcode_8F() {
-	ram[pc] = ram[r7];
-	pc += 1;
-}
-void cpu::opcode_90() {
-	ushort address = (rom[pc] << 8) | rom[pc + 1];
-	setDPTR(address);
-	pc += 2;
-}
-void cpu::opcode_91() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	ushort address = pc;
-	ram[sp]++;
-	ram[ram[sp]] = address & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (address >> 8) & 0xFF;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_92() {}
-void cpu::opcode_93() {}
-void cpu::opcode_94() {
-	unsigned char res = ram[acc] - rom[pc];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(rom[pc] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && rom[pc] > 0x7F) ||
-		(ram[acc] > 0x7F && rom[pc] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((rom[pc] + carry) & 0x0F) ||
-		carry && ((rom[pc] & 0x0F) == 0x0F));
-	++pc;
-}
-void cpu::opcode_95() {
-	unsigned char res = ram[acc] - ram[pc];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[pc] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[pc] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[pc] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[pc] + carry) & 0x0F) ||
-		carry && ((ram[pc] & 0x0F) == 0x0F));
-	++pc;
-}
-void cpu::opcode_96() {
-	unsigned char res = ram[acc] - ram[ram[r0]];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[ram[r0]] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[ram[r0]] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[ram[r0]] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[ram[r0]] + carry) & 0x0F) ||
-		carry && ((ram[ram[r0]] & 0x0F) == 0x0F));
-}
-void cpu::opcode_97() {
-	unsigned char res = ram[acc] - ram[ram[r1]];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[ram[r1]] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[ram[r1]] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[ram[r1]] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[ram[r1]] + carry) & 0x0F) ||
-		carry && ((ram[ram[r1]] & 0x0F) == 0x0F));
-}
-void cpu::opcode_98() {
-	unsigned char res = ram[acc] - ram[r0];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[r0] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[r0] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[r0] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[r0] + carry) & 0x0F) ||
-		carry && ((ram[r0] & 0x0F) == 0x0F));
-}
-void cpu::opcode_99() {
-	unsigned char res = ram[acc] - ram[r1];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[r1] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[r1] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[r1] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[r1] + carry) & 0x0F) ||
-		carry && ((ram[r1] & 0x0F) == 0x0F));
-}
-void cpu::opcode_9A() {
-	unsigned char res = ram[acc] - ram[r2];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[r2] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[r2] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[r2] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[r2] + carry) & 0x0F) ||
-		carry && ((ram[r2] & 0x0F) == 0x0F));
-}
-void cpu::opcode_9B() {
-	unsigned char res = ram[acc] - ram[r3];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[r3] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[r3] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[r3] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[r3] + carry) & 0x0F) ||
-		carry && ((ram[r3] & 0x0F) == 0x0F));
-}
-void cpu::opcode_9C() {
-	unsigned char res = ram[acc] - ram[r4];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[r4] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[r4] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[r4] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[r4] + carry) & 0x0F) ||
-		carry && ((ram[r4] & 0x0F) == 0x0F));
-}
-void cpu::opcode_9D() {
-	unsigned char res = ram[acc] - ram[r5];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[r5] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[r5] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[r5] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[r5] + carry) & 0x0F) ||
-		carry && ((ram[r5] & 0x0F) == 0x0F));
-}
-void cpu::opcode_9E() {
-	unsigned char res = ram[acc] - ram[r6];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[r6] + carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[r6] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[r6] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[r6] + carry) & 0x0F) ||
-		carry && ((ram[r6] & 0x0F) == 0x0F));
-}
-void cpu::opcode_9F() {
-	unsigned char res = ram[acc] - ram[r7];
-	auto carry = PSW_C();
-	if (carry)
-		res--;
-
-	setPSW_C(((unsigned int)ram[acc] < (unsigned int)(ram[r7]+ carry)));
-	setPSW_OV((ram[acc] < 0x80 && ram[r7] > 0x7F) ||
-		(ram[acc] > 0x7F && ram[r7] < 0x80));
-	setPSW_AC((ram[acc] & 0x0F) < ((ram[r7] + carry) & 0x0F) ||
-		carry && ((ram[r7] & 0x0F) == 0x0F));
-}
-void cpu::opcode_A0() {}
-void cpu::opcode_A1() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	++pc;
-	high >>= 5;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_A2() {}
-void cpu::opcode_A3() {}
-void cpu::opcode_A4() {}
-void cpu::opcode_A5() {}
-void cpu::opcode_A6() {
-	ram[ram[r0]] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_A7() {
-	ram[ram[r1]] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_A8() {
-	ram[r0] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_A9() {
-	ram[r1] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_AA() {
-	ram[r2] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_AB() {
-	ram[r3] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_AC() {
-	ram[r4] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_AD() {
-	ram[r5] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_AE() {
-	ram[r6] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_AF() {
-	ram[r7] = ram[pc];
-	pc += 1;
-}
-void cpu::opcode_B0() {}
-void cpu::opcode_B1() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	ushort address = pc;
-	ram[sp]++;
-	ram[ram[sp]] = address & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (address >> 8) & 0xFF;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_B2() {}
-void cpu::opcode_B3() {
-	setPSW_C(~PSW_C());
-}
-void cpu::opcode_B4() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[acc] != immediate)
-		pc += offset;
-	if (ram[acc] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+void cpu::op_jnz(uchar op1, uchar)
+{
+	if (hot.a != 0) {
+		hot.pc += (schar)op1;
+	}
 }
-void cpu::opcode_B5() {
-	auto immediate = ram[rom[pc++]];
-	schar offset = (schar)rom[pc++];
-	if (ram[acc] != immediate)
-		pc += offset;
-	if (ram[acc] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+//JB (SET), JNB (!SET) and JBC (SET, CLEAR)
+template<bool SET, bool CLEAR>
+void cpu::op_jbit(uchar op1, uchar op2)
+{
+	if (getBit(op1) == SET) {
+		if constexpr (CLEAR) {
+			setBit(op1, false);
+		}
+		hot.pc += (schar)op2;
+	}
 }
-void cpu::opcode_B6() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[ram[r0]] != immediate)
-		pc += offset;
-	if (ram[ram[r0]] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+//Compares D with S; C is set when D is smaller. S is always the first operand byte.
+template<cpu::addressing_t D, cpu::addressing_t S, uchar N>
+void cpu::op_cjne(uchar op1, uchar op2)
+{
+	uchar dst = load<D, N>(0);
+	uchar src = load<S, N>(op1);
+	setPSW_C(dst < src);
+	if (dst != src) {
+		hot.pc += (schar)op2;
+	}
 }
-void cpu::opcode_B7() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[ram[r1]] != immediate)
-		pc += offset;
-	if (ram[ram[r1]] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+template<cpu::addressing_t M, uchar N>
+void cpu::op_djnz(uchar op1, uchar op2)
+{
+	uchar value = load<M, N>(op1) - 1;
+	store<M, N>(op1, value);
+	if (value != 0) {
+		hot.pc += (schar)(M == addressing_t::direct ? op2 : op1);
+	}
 }
-void cpu::opcode_B8() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[r0] != immediate)
-		pc += offset;
-	if (ram[r0] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+void cpu::op_rr(uchar, uchar)
+{
+	hot.a = (hot.a >> 1) | (hot.a << 7);
 }
-void cpu::opcode_B9() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[r1] != immediate)
-		pc += offset;
-	if (ram[r1] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+void cpu::op_rrc(uchar, uchar)
+{
+	uchar carry = hot.a & 0x01;
+	hot.a = (hot.a >> 1) | (PSW_C() ? 0x80 : 0x00);
+	setPSW_C(carry);
 }
-void cpu::opcode_BA() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[r2] != immediate)
-		pc += offset;
-	if (ram[r2] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+void cpu::op_rl(uchar, uchar)
+{
+	hot.a = (hot.a << 1) | (hot.a >> 7);
 }
-void cpu::opcode_BB() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[r3] != immediate)
-		pc += offset;
-	if (ram[r3] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+void cpu::op_rlc(uchar, uchar)
+{
+	uchar carry = hot.a & 0x80;
+	hot.a = (hot.a << 1) | (PSW_C() ? 0x01 : 0x00);
+	setPSW_C(carry);
 }
-void cpu::opcode_BC() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[r4] != immediate)
-		pc += offset;
-	if (ram[r4] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+void cpu::op_swap(uchar, uchar)
+{
+	hot.a = (hot.a << 4) | (hot.a >> 4);
 }
-void cpu::opcode_BD() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[r5] != immediate)
-		pc += offset;
-	if (ram[r5] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+void cpu::op_clr_a(uchar, uchar)
+{
+	hot.a = 0x00;
 }
-void cpu::opcode_BE() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[r6] != immediate)
-		pc += offset;
-	if (ram[r6] < immediate)
-		setPSW_C(1);
-	else
-		setPSW_C(0);
+
+void cpu::op_cpl_a(uchar, uchar)
+{
+	hot.a = ~hot.a;
 }
-void cpu::opcode_BF() {
-	auto immediate = rom[pc++];
-	schar offset = (schar)rom[pc++];
-	if (ram[r7] != immediate)
-		pc += offset;
-	if (ram[r7] < immediate)
+
+void cpu::op_da(uchar, uchar)
+{
+	unsigned int a = hot.a;
+	if ((a & 0x0F) > 0x09 || PSW_AC()) {
+		a += 0x06;
+	}
+	if (a > 0xFF || (a & 0xF0) > 0x90 || PSW_C()) {
+		a += 0x60;
 		setPSW_C(1);
-	else
-		setPSW_C(0);
-}
-void cpu::opcode_C0() {
-	ram[sp]++;
-	ram[ram[sp]] = ram[rom[pc++]];
-}
-void cpu::opcode_C1() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	++pc;
-	high >>= 5;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_C2() {}
-void cpu::opcode_C3() {
-	setPSW_C(0x00);
-}
-void cpu::opcode_C4() {
-	auto high = ram[acc] >> 4;
-	ram[acc] = (ram[acc] << 4) | high;
-}
-void cpu::opcode_C5() {
-	auto temp = ram[acc];
-	ram[acc] = ram[pc];
-	ram[pc] = temp;
-}
-void cpu::opcode_C6() {
-	auto temp = ram[acc];
-	ram[acc] = ram[ram[r0]];
-	ram[ram[r0]] = temp;
-}
-void cpu::opcode_C7() {
-	auto temp = ram[acc];
-	ram[acc] = ram[ram[r1]];
-	ram[ram[r1]] = temp;
-}
-void cpu::opcode_C8() {
-	auto temp = ram[acc];
-	ram[acc] = ram[r0];
-	ram[r0] = temp;
-}
-void cpu::opcode_C9() {
-	auto temp = ram[acc];
-	ram[acc] = ram[r1];
-	ram[r1] = temp;
-}
-void cpu::opcode_CA() {
-	auto temp = ram[acc];
-	ram[acc] = ram[r2];
-	ram[r2] = temp;
-}
-void cpu::opcode_CB() {
-	auto temp = ram[acc];
-	ram[acc] = ram[r3];
-	ram[r3] = temp;
-}
-void cpu::opcode_CC() {
-	auto temp = ram[acc];
-	ram[acc] = ram[r4];
-	ram[r4] = temp;
-}
-void cpu::opcode_CD() {
-	auto temp = ram[acc];
-	ram[acc] = ram[r5];
-	ram[r5] = temp;
-}
-void cpu::opcode_CE() {
-	auto temp = ram[acc];
-	ram[acc] = ram[r6];
-	ram[r6] = temp;
-}
-void cpu::opcode_CF() {
-	auto temp = ram[acc];
-	ram[acc] = ram[r7];
-	ram[r7] = temp;
-}
-void cpu::opcode_D0() {
-	ram[rom[pc++]] = ram[ram[sp]];
-	ram[sp]--;
-}
-void cpu::opcode_D1() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	ushort address = pc;
-	ram[sp]++;
-	ram[ram[sp]] = address & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (address >> 8) & 0xFF;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_D2() {}
-void cpu::opcode_D3() {
-	setPSW_C(1);
-}
-void cpu::opcode_D4() {
-	if ((ram[acc] & 0x0F) > 9 || (PSW_AC() >> 6) == 1)
-		ram[acc] += 6;
-	if ((ram[acc] & 0xF0) > 9 || (PSW_C() >> 7) == 1)
-		ram[acc] += 0x60;
+	}
+	hot.a = (uchar)a;
 }
-void cpu::opcode_D5() {
-	ram[rom[pc++]] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[rom[pc++]] != 0) {
-		pc = pc + offset;
-	}
+
+void cpu::op_mul(uchar, uchar)
+{
+	unsigned int result = hot.a * sfr[b - sfr_base];
+	hot.a = result & 0xFF;
+	sfr[b - sfr_base] = result >> 8;
+	setPSW_C(0);
+	setPSW_OV(result > 0xFF);
 }
-void cpu::opcode_D6() {
-	auto temp = ram[acc];
-	auto temp1 = ram[ram[r0]];
-	temp &= 0x0F;
-	temp1 &= 0x0F;
-	ram[acc] &= 0x0F;
-	ram[ram[r0]] &= 0x0F;
-	ram[acc] |= temp1;
-	ram[ram[r0]] |= temp;
+
+void cpu::op_div(uchar, uchar)
+{
+	setPSW_C(0);
+	if (sfr[b - sfr_base] == 0) {
+		setPSW_OV(1);
+		return;
+	}
+	uchar quotient = hot.a / sfr[b - sfr_base];
+	sfr[b - sfr_base] = hot.a % sfr[b - sfr_base];
+	hot.a = quotient;
+	setPSW_OV(0);
 }
-void cpu::opcode_D7() {
-	auto temp = ram[acc];
-	auto temp1 = ram[ram[r1]];
-	temp &= 0x0F;
-	temp1 &= 0x0F;
-	ram[acc] &= 0x0F;
-	ram[ram[r1]] &= 0x0F;
-	ram[acc] |= temp1;
-	ram[ram[r1]] |= temp;
+
+template<cpu::addressing_t M, uchar N>
+void cpu::op_inc(uchar op1, uchar)
+{
+	store<M, N>(op1, load<M, N>(op1) + 1);
 }
-void cpu::opcode_D8() {
-	ram[r0] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[r0] != 0) {
-		pc = pc + offset;
-	}
+
+template<cpu::addressing_t M, uchar N>
+void cpu::op_dec(uchar op1, uchar)
+{
+	store<M, N>(op1, load<M, N>(op1) - 1);
 }
-void cpu::opcode_D9() {
-	ram[r1] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[r1] != 0) {
-		pc = pc + offset;
-	}
+
+void cpu::op_inc_dptr(uchar, uchar)
+{
+	setDPTR(getDPTR() + 1);
 }
-void cpu::opcode_DA() {
-	ram[r2] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[r2] != 0) {
-		pc = pc + offset;
-	}
+
+template<cpu::addressing_t M, uchar N>
+void cpu::op_add(uchar op1, uchar)
+{
+	add(load<M, N>(op1), 0);
 }
-void cpu::opcode_DB() {
-	ram[r3] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[r3] != 0) {
-		pc = pc + offset;
-	}
+
+template<cpu::addressing_t M, uchar N>
+void cpu::op_addc(uchar op1, uchar)
+{
+	add(load<M, N>(op1), PSW_C() ? 1 : 0);
 }
-void cpu::opcode_DC() {
-	ram[r4] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[r4] != 0) {
-		pc = pc + offset;
-	}
+
+template<cpu::addressing_t M, uchar N>
+void cpu::op_subb(uchar op1, uchar)
+{
+	subb(load<M, N>(op1), PSW_C() ? 1 : 0);
 }
-void cpu::opcode_DD() {
-	ram[r5] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[r5] != 0) {
-		pc = pc + offset;
+
+//ORL/ANL/XRL. A direct destination takes the first operand byte, the
+//source then takes the second one.
+template<cpu::alu_t OP, cpu::addressing_t D, cpu::addressing_t S, uchar N>
+void cpu::op_logic(uchar op1, uchar op2)
+{
+	uchar dst = load<D, N>(op1);
+	uchar src = load<S, N>(D == addressing_t::direct ? op2 : op1);
+	if constexpr (OP == alu_t::orl) {
+		dst |= src;
 	}
-}
-void cpu::opcode_DE() {
-	ram[r6] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[r6] != 0) {
-		pc = pc + offset;
+	else if constexpr (OP == alu_t::anl) {
+		dst &= src;
 	}
-}
-void cpu::opcode_DF() {
-	ram[r7] -= 1;
-	schar offset = (schar)rom[pc++];
-	if (ram[r7] != 0) {
-		pc = pc + offset;
+	else {
+		dst ^= src;
 	}
+	store<D, N>(op1, dst);
 }
-void cpu::opcode_E0() {}
-void cpu::opcode_E1() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	++pc;
-	high >>= 5;
-	pc = (high << 8) | low;
-}
-void cpu::opcode_E2() {
-	ram[acc] = ram[ram[r0]];
-}
-void cpu::opcode_E3() {
-	ram[acc] = ram[ram[r1]];
-}
-void cpu::opcode_E4() {
-	ram[acc] = 0x00;
-}
-void cpu::opcode_E5() {
-	ram[acc] = ram[rom[pc]];
-	++pc;
-}
-void cpu::opcode_E6() {
-	ram[acc] = ram[ram[r0]];
-}
-void cpu::opcode_E7() {
-	ram[acc] = ram[ram[r1]];
-}
-void cpu::opcode_E8() {
-	ram[acc] = ram[r0];
-}
-void cpu::opcode_E9() {
-	ram[acc] = ram[r1];
-}
-void cpu::opcode_EA() {
-	ram[acc] = ram[r2];
-}
-void cpu::opcode_EB() {
-	ram[acc] = ram[r3];
+
+void cpu::op_clr_c(uchar, uchar)
+{
+	setPSW_C(0);
 }
-void cpu::opcode_EC() {
-	ram[acc] = ram[r4];
+
+void cpu::op_setb_c(uchar, uchar)
+{
+	setPSW_C(1);
 }
-void cpu::opcode_ED() {
-	ram[acc] = ram[r5];
+
+void cpu::op_cpl_c(uchar, uchar)
+{
+	setPSW_C(!PSW_C());
 }
-void cpu::opcode_EE() {
-	ram[acc] = ram[r6];
+
+void cpu::op_clr_bit(uchar op1, uchar)
+{
+	setBit(op1, false);
 }
-void cpu::opcode_EF() {
-	ram[acc] = ram[r7];
+
+void cpu::op_setb_bit(uchar op1, uchar)
+{
+	setBit(op1, true);
 }
-void cpu::opcode_F0() {}
-void cpu::opcode_F1() {
-	uchar low = rom[pc];
-	ushort high = rom[pc - 1];
-	high >>= 5;
-	++pc;
-	ushort address = pc;
-	ram[sp]++;
-	ram[ram[sp]] = address & 0xFF;
-	ram[sp]++;
-	ram[ram[sp]] = (address >> 8) & 0xFF;
-	pc = (high << 8) | low;
+
+void cpu::op_cpl_bit(uchar op1, uchar)
+{
+	setBit(op1, !getBit(op1));
 }
-void cpu::opcode_F2() {
-	ram[ram[r0]] = ram[acc];
+
+template<bool INVERT>
+void cpu::op_anl_c(uchar op1, uchar)
+{
+	if (getBit(op1) == INVERT) {
+		setPSW_C(0);
+	}
 }
-void cpu::opcode_F3() {
-	ram[ram[r1]] = ram[acc];
+
+template<bool INVERT>
+void cpu::op_orl_c(uchar op1, uchar)
+{
+	if (getBit(op1) != INVERT) {
+		setPSW_C(1);
+	}
 }
-void cpu::opcode_F4() {
-	ram[acc] = ~ram[acc];
+
+void cpu::op_mov_c_bit(uchar op1, uchar)
+{
+	setPSW_C(getBit(op1));
 }
-void cpu::opcode_F5() {
-	ram[rom[pc]] = ram[acc];
-	++pc;
+
+void cpu::op_mov_bit_c(uchar op1, uchar)
+{
+	setBit(op1, PSW_C() != 0);
 }
-void cpu::opcode_F6() {
-	ram[ram[r0]] = ram[acc];
+
+//MOV. A direct destination takes the first operand byte, except for
+//MOV direct,direct which is encoded source first.
+template<cpu::addressing_t D, cpu::addressing_t S, uchar N>
+void cpu::op_mov(uchar op1, uchar op2)
+{
+	if constexpr (D == addressing_t::direct && S == addressing_t::direct) {
+		store<D, N>(op2, load<S, N>(op1));
+	}
+	else {
+		store<D, N>(op1, load<S, N>(D == addressing_t::direct ? op2 : op1));
+	}
 }
-void cpu::opcode_F7() {
-	ram[ram[r1]] = ram[acc];
+
+void cpu::op_mov_dptr(uchar op1, uchar op2)
+{
+	setDPTR((op1 << 8) | op2);
 }
-void cpu::opcode_F8() {
-	ram[r0] = ram[acc];
+
+void cpu::op_movc_pc(uchar, uchar)
+{
+	hot.a = rom[(ushort)(hot.a + hot.pc)];
 }
-void cpu::opcode_F9() {
-	ram[r1] = ram[acc];
+
+void cpu::op_movc_dptr(uchar, uchar)
+{
+	hot.a = rom[(ushort)(hot.a + getDPTR())];
 }
-void cpu::opcode_FA() {
-	ram[r2] = ram[acc];
+
+//MOVX through @DPTR (indexed) or @Ri with P2 supplying the high address byte
+template<bool WRITE, cpu::addressing_t M, uchar N>
+void cpu::op_movx(uchar, uchar)
+{
+	ushort address = M == addressing_t::indexed ? getDPTR() : (sfr[p2 - sfr_base] << 8) | ram[hot.bank + N];
+	if constexpr (WRITE) {
+		xram[address] = hot.a;
+	}
+	else {
+		hot.a = xram[address];
+	}
 }
-void cpu::opcode_FB() {
-	ram[r3] = ram[acc];
+
+void cpu::op_push(uchar op1, uchar)
+{
+	push(load<addressing_t::direct, 0>(op1));
 }
-void cpu::opcode_FC() {
-	ram[r4] = ram[acc];
+
+void cpu::op_pop(uchar op1, uchar)
+{
+	store<addressing_t::direct, 0>(op1, pop());
 }
-void cpu::opcode_FD() {
-	ram[r5] = ram[acc];
+
+template<cpu::addressing_t M, uchar N>
+void cpu::op_xch(uchar op1, uchar)
+{
+	uchar temp = hot.a;
+	hot.a = load<M, N>(op1);
+	store<M, N>(op1, temp);
 }
-void cpu::opcode_FE() {
-	ram[r6] = ram[acc];
+
+template<uchar N>
+void cpu::op_xchd(uchar, uchar)
+{
+	uchar temp = hot.a;
+	hot.a = (hot.a & 0xF0) | (ram[ram[hot.bank + N]] & 0x0F);
+	ram[ram[hot.bank + N]] = (ram[ram[hot.bank + N]] & 0xF0) | (temp & 0x0F);
 }
-void cpu::opcode_FF() {
-	ram[r7] = ram[acc];
+
+//A firmware translated by recompile() is built in by defining CPU_RECOMPILED
+//to the name of the generated file. Without one the engine interprets.
+#ifdef CPU_RECOMPILED
+#include CPU_RECOMPILED
+#else
+void cpu::executeRecompiled(unsigned long instructions)
+{
+	executePredecoded(instructions);
 }
+#endif
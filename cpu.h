@@ -1,32 +1,238 @@
 #pragma once
 #include <iostream>
+#include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <ctime>
 #include <chrono>
+#include "jit.h"
+#include "ring.h"
 
 typedef unsigned char uchar;
 typedef signed char schar;
 typedef unsigned short ushort;
 
 #define RAM_SIZE 256
-#define ROM_SIZE 4 * 1024
+#define SFR_SIZE 128
+#define ROM_SIZE (64 * 1024)
+#define XRAM_SIZE (64 * 1024)
 #define OPCODES_SIZE 256
-#define MAX_CYCLES_PER_SECOND 1000000
+#define DEFAULT_OSCILLATOR_HZ 12000000
+#define DEFAULT_CLOCKS_PER_CYCLE 12
+#define MAX_BLOCK_LENGTH 64
+#define SERIAL_RING_SIZE (64 * 1024)
+//Real-time pacing: emulated time run between checks against the host clock,
+//how far ahead of the host the emulation gets before it sleeps, the
+//shortest stretch at the end of a sleep that is spun instead, and how far
+//behind the host may fall before the schedule restarts from now
+#define PACING_BATCH_NS 1000000
+#define PACING_WINDOW_NS 4000000
+#define PACING_SPIN_NS 100000
+#define PACING_MAX_LAG_NS 50000000
 
-#define get16hex(mem, idx) (((ushort)(mem[idx] << 8)) | mem[idx + 1])
+//Execution engine selection. The table engine is the original pointer-to-member
+//lookup in opcodeHandler, the threaded engine dispatches through a switch or,
+//where the compiler supports labels-as-values, a computed goto table. The
+//predecoded engine runs from records decoded once when the ROM is loaded and
+//the block engine from cached, chained basic blocks of those records. The jit
+//engine is the block engine with hot blocks translated to native code. The
+//recompiled engine runs C++ emitted for one firmware image by recompile() and
+//built in with CPU_RECOMPILED; other images fall back to the predecoded engine.
+#ifndef CPU_DEFAULT_ENGINE
+#define CPU_DEFAULT_ENGINE cpu::engine_t::threaded
+#endif
+//Fused superinstructions in the predecoded engine, see cpu::fusions
+#ifndef CPU_ENABLE_FUSION
+#define CPU_ENABLE_FUSION true
+#endif
+#if !defined(CPU_USE_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_USE_COMPUTED_GOTO 1
+#endif
 
 typedef void callBackForEveryCycle_t(void*);
+//SFR hooks let peripherals see firmware accesses as they happen. A read
+//hook receives the stored value and returns the one the firmware reads; a
+//write hook runs after the value has been stored.
+typedef uchar sfrReadHook_t(void* context, uchar address, uchar value);
+typedef void sfrWriteHook_t(void* context, uchar address, uchar value);
+typedef void eventHandler_t(void* context);
 
 class cpu
 {
 public:
-	typedef void (cpu::* opcodeHandler_t)();
+	//Handlers receive the two bytes following the opcode; pc already points
+	//to the next instruction when they run.
+	typedef void (cpu::* opcodeHandler_t)(uchar op1, uchar op2);
+
+	enum class addressing_t : uchar {
+		implied,	//no operand, or A / C only
+		acc,		//accumulator
+		reg,		//R0-R7
+		direct,		//internal RAM / SFR address
+		indirect,	//@R0, @R1
+		immediate,	//#data
+		bit,		//bit address
+		relative,	//signed 8-bit offset
+		absolute,	//addr11, addr16
+		indexed,	//@A+DPTR, @A+PC, @DPTR
+	};
+
+	//One entry of the instruction set description table
+	struct instruction_t {
+		const char* mnemonic;
+		addressing_t mode;
+		uchar length;
+		uchar cycles;
+		opcodeHandler_t handler;
+	};
+	static const instruction_t isa[OPCODES_SIZE];
+
+	//An instruction decoded from ROM with its operand bytes already fetched.
+	//A fused record runs count instructions, its operand bytes packed in order.
+	struct decoded_t {
+		opcodeHandler_t handler;
+		uchar opcode;
+		uchar op1;
+		uchar op2;
+		uchar length;
+		uchar cycles;
+		uchar count = 1;
+		bool idle = false;	//see isIdleLoop()
+		bool delay = false;	//see isDelayLoop()
+	};
+
+	//A sequence of up to three opcodes the predecoded engine runs through
+	//one handler. Only the last may branch and together they take at most
+	//two operand bytes.
+	struct fusion_t {
+		uchar opcodes[3];
+		uchar count;
+		opcodeHandler_t handler;
+	};
+	static const fusion_t fusions[];
+
+	//Everything buildImage() derives from a loaded image, never written once
+	//built. code holds a full 64K image per bank with the common area below
+	//the banking window copied into each, then two more bytes so operand
+	//fetches at 0xFFFE and 0xFFFF wrap around without masking pc. decoded
+	//and fused only have records for the first end addresses of each bank,
+	//laid out per bank the same way; past them code memory is unloaded
+	//filler.
+	struct image_t {
+		std::vector<uchar> code;
+		std::vector<decoded_t> decoded;
+		std::vector<decoded_t> fused;
+		unsigned int end = 0;
+		unsigned int checksum = 0;
+	};
+
+	enum class engine_t {
+		table,		//opcodeHandler[rom[pc]] member function pointer call
+		threaded,	//switch / computed goto dispatch
+		predecoded,	//decoded[pc] record built at ROM load time
+		block,		//cached basic blocks chained to their successors
+		jit,		//block engine with hot blocks compiled to x86-64
+		recompiled,	//firmware translated ahead of time by recompile()
+	};
+
+	cpu();
+	cpu(const cpu&) = delete;
+	cpu& operator=(const cpu&) = delete;
+	cpu(cpu&&) = default;
+	cpu& operator=(cpu&&) = default;
 
-	static cpu* getInstance();
 	bool initialize(const std::string& fileName, callBackForEveryCycle_t callback, void* obj);
+	//Runs the image another core loaded instead of reading a file, so cores
+	//running the same firmware hold one copy of its code and records
+	//between them. Banking is still configured per core.
+	bool initialize(std::shared_ptr<const image_t> shared, callBackForEveryCycle_t callback, void* obj);
+	std::shared_ptr<const image_t> getImage() {
+		return image;
+	}
 	void emulateCycle();
+	void execute(unsigned long instructions);
+	void runCycles(unsigned long long count);
+	void runNanoseconds(unsigned long long nanoseconds);
+
+	//Machine cycles executed since initialize(). A machine cycle is
+	//clocksPerCycle oscillator periods: 12 on classic cores, 1 on
+	//single-cycle derivatives.
+	unsigned long long getCycles() {
+		return cycles;
+	}
+	//Fails, keeping the current clock, unless the oscillator gives at least
+	//one machine cycle per second.
+	bool setClock(unsigned long oscillatorHz, unsigned int clocksPerCycle);
+	unsigned long long getCyclesPerSecond() {
+		return oscillator / clocksPerMachineCycle;
+	}
+	unsigned long long getNanoseconds();
+	//Paces emulateCycle() to the configured clock instead of running as
+	//fast as the host allows. Configuration, survives initialize().
+	void setRealTime(bool enabled) {
+		realTime = enabled;
+	}
+
+	//Peripheral events. addEvent() registers a handler once and returns
+	//the id it is scheduled by; scheduleEvent() arms it for an absolute
+	//machine cycle, replacing any deadline it had. An event runs at the
+	//first instruction boundary at or past its deadline. Registrations
+	//survive initialize(), pending deadlines do not.
+	int addEvent(eventHandler_t* handler, void* context);
+	void scheduleEvent(int id, unsigned long long cycle);
+	void cancelEvent(int id);
+	void setEngine(engine_t e) {
+		engine = e;
+	}
+	engine_t getEngine() {
+		return engine;
+	}
+	void setFusion(bool enabled) {
+		fusion = enabled;
+	}
+	void setProfiling(bool enabled);
+	void reportProfile(std::ostream& out, int top = 20);
+	//Banked code: the bits in mask of the SFR at selectAddress pick the bank
+	//seen from windowStart up, below it every bank shares bank 0's code.
+	//Banks are loaded from HEX files at linear address bank * 64K + address.
+	//Configure before initialize(); the setting survives it.
+	void setCodeBanking(uchar selectAddress, uchar mask, ushort windowStart = 0x8000);
+	unsigned int getCodeBank() {
+		return codeBank;
+	}
+	//Hooks are configuration and survive initialize(); nullptr removes one.
+	//ACC, PSW, SP, DPL and DPH live in hot and cannot be hooked.
+	void setSFRReadHook(uchar address, sfrReadHook_t* hook, void* context);
+	void setSFRWriteHook(uchar address, sfrWriteHook_t* hook, void* context);
+	//Drives the INT0 (line 0) or INT1 (line 1) pin, P3.2 or P3.3. A falling
+	//edge sets IE0/IE1 when ITx is set, otherwise the flag follows the pin
+	//being low.
+	void setInterruptPin(int line, bool high);
+	//Bytes the firmware transmitted on the serial port, in order. One host
+	//thread may drain them while another runs the emulation, which never
+	//waits for it: bytes that find the ring full are dropped and counted.
+	size_t readSerialOutput(uchar* buffer, size_t size) {
+		return serialOutput->pop(buffer, size);
+	}
+	unsigned long long getSerialDropped() {
+		return serialDropped;
+	}
+	//Bytes for the firmware to receive, from one host thread. Each arrives
+	//in SBUF with RI set one frame after the previous one, and not before
+	//REN is set and RI has been cleared, so none is overrun. Bytes that
+	//find the line idle are picked up when the next execute() starts.
+	//Returns how many fit in the ring; the caller offers the rest again
+	//later.
+	size_t writeSerialInput(const uchar* buffer, size_t size) {
+		return serialInput->push(buffer, size);
+	}
 	void dumpPort1();
+	//Makes emulateCycle() return after its current batch. Safe to call from
+	//any thread, also before emulateCycle() has started, which then returns
+	//at once.
 	void stopEmulation();
+	bool recompile(const std::string& fileName);
 
 	uchar PSW_C();		//Carry
 	uchar PSW_AC();		//Auxilary Carry
@@ -37,109 +243,173 @@ public:
 	uchar PSW_P();		//Parity - Set to 1 if A has odd # of 1's; otherwise reset
 
 	uchar getP0() {
-		return ram[p0];
+		return sfr[p0 - sfr_base];
 	}
 	uchar getP1() {
-		return ram[p1];
+		return sfr[p1 - sfr_base];
 	}
 	uchar getP2() {
-		return ram[p2];
+		return sfr[p2 - sfr_base];
 	}
 	uchar getP3() {
-		return ram[p3];
+		return sfr[p3 - sfr_base];
 	}
 
 	uchar getR0() {
-		return ram[r0];
+		return ram[hot.bank + r0];
 	}
 	uchar getR1() {
-		return ram[r1];
+		return ram[hot.bank + r1];
 	}
 	uchar getR2() {
-		return ram[r2];
+		return ram[hot.bank + r2];
 	}
 	uchar getR3() {
-		return ram[r3];
+		return ram[hot.bank + r3];
 	}
 	uchar getR4() {
-		return ram[r4];
+		return ram[hot.bank + r4];
 	}
 	uchar getR5() {
-		return ram[r5];
+		return ram[hot.bank + r5];
 	}
 	uchar getR6() {
-		return ram[r6];
+		return ram[hot.bank + r6];
 	}
 	uchar getR7() {
-		return ram[r7];
+		return ram[hot.bank + r7];
 	}
 
 	uchar getB() {
-		return ram[b];
+		return sfr[b - sfr_base];
 	}
 	uchar getACC() {
-		return ram[acc];
+		return hot.a;
 	}
 	uchar getIP() {
-		return ram[ip];
+		return sfr[ip - sfr_base];
 	}
 	uchar getIE() {
-		return ram[ie];
+		return sfr[ie - sfr_base];
 	}
 	uchar getTMOD() {
-		return ram[tmod];
+		return sfr[tmod - sfr_base];
 	}
 	uchar getTCON() {
-		return ram[tcon];
+		return peekTimers().control;
 	}
 	uchar getPCON() {
-		return ram[pcon];
+		return sfr[pcon - sfr_base];
 	}
 	uchar getDPH() {
-		return ram[dph];
+		return hot.dptr >> 8;
 	}
 	uchar getDPL() {
-		return ram[dpl];
+		return hot.dptr & 0xFF;
 	}
 	uchar getSP() {
-		return ram[sp];
+		return hot.sp;
 	}
 	uchar getPSW() {
-		return ram[psw];
+		return peekPSW();
 	}
 
 	ushort getPC() {
-		return pc;
+		return hot.pc;
 	}
 
 	uchar getTH0() {
-		return ram[th0];
+		return peekTimers().high0;
 	}
 	uchar getTH1() {
-		return ram[th1];
+		return peekTimers().high1;
 	}
 	uchar getTL0() {
-		return ram[tl0];
+		return peekTimers().low0;
 	}
 	uchar getTL1() {
-		return ram[tl1];
+		return peekTimers().low1;
 	}
 
 private:
-	cpu() = default;
-	cpu(const cpu&) = delete;
-	cpu& operator=(const cpu&) = delete;
-	cpu(const cpu&&) = delete;
-	cpu& operator=(const cpu&&) = delete;
-
 	void clear();
-	bool readhexfile(const std::string& fileName);
+	bool readhexfile(const std::string& fileName, std::vector<uchar>& code, unsigned int& end);
 	int getNumberofLines(FILE* fp);
-	bool readLineData(FILE* fp, int& memoryLocation);
+	bool readLineData(FILE* fp, int& memoryLocation, unsigned long& extendedAddress,
+		std::vector<uchar>& code, unsigned int& end);
 	void readByte(FILE* fp, uchar& ch);
 	void clearSpecialCharacters(FILE* fp, uchar& ch);
 	uchar asciiToHex(uchar ch);
 	void initOpcodeArray();
+	void executeTable(unsigned long instructions);
+	void executeThreaded(unsigned long instructions);
+	template<uchar OP> void step(unsigned long& instructions);
+	template<uchar OP> void exec(uchar op1, uchar op2);
+
+	//Idle loops: an instruction that branches to itself and, apart from
+	//that, does nothing, such as SJMP $ or JNB TI,$. What it tests only
+	//changes when an event runs, so every iteration up to the next event is
+	//the same and fastForward() accounts for them in one step.
+	static constexpr bool isIdleOpcode(uchar opcode) {
+		return opcode == 0x02 || opcode == 0x20 || opcode == 0x30 || opcode == 0x40 ||
+			opcode == 0x50 || opcode == 0x60 || opcode == 0x70 || opcode == 0x80 ||
+			(opcode & 0x1F) == 0x01;
+	}
+	static constexpr bool isIdleLoop(ushort address, uchar opcode, uchar op1, uchar op2) {
+		switch (opcode) {
+		case 0x02:	//LJMP
+			return ((op1 << 8) | op2) == address;
+		case 0x20: case 0x30:	//JB, JNB
+			return op2 == 0xFD;
+		case 0x40: case 0x50: case 0x60: case 0x70: case 0x80:	//JC, JNC, JZ, JNZ, SJMP
+			return op1 == 0xFE;
+		default:	//AJMP
+			return (opcode & 0x1F) == 0x01 &&
+				((((address + 2) & 0xF800) | ((opcode >> 5) << 8) | op1) == address);
+		}
+	}
+	bool staysIdle(uchar opcode, uchar op1);
+	unsigned long fastForward(unsigned long instructions, uchar loopCycles);
+
+	//Delay loops: DJNZ Rn,$ counting a register down, possibly nested in a
+	//DJNZ Rm that loops back to it or to a MOV Rn,#k just before it. Only
+	//registers change, so skipDelay() works out their values and the
+	//cycles taken instead of running the passes.
+	static constexpr bool isDelayLoop(uchar opcode, uchar op1) {
+		return (opcode & 0xF8) == 0xD8 && op1 == 0xFE;
+	}
+	unsigned long skipDelay(unsigned long instructions);
+	void executePredecoded(unsigned long instructions);
+	static decoded_t decode(const uchar* window, ushort address);
+	static std::shared_ptr<const image_t> buildImage(std::vector<uchar>& code, unsigned int end);
+	static void fuse(image_t& image);
+	void adoptImage();
+	void executeProfiled(unsigned long instructions);
+	template<uchar OP, uchar... REST> void stepFused(uchar op1, uchar op2);
+
+	//Straight-line run of decoded instructions ending at the first branch.
+	//successor caches the blocks last reached through the taken exit [0]
+	//and the fall-through exit [1].
+	struct block_t {
+		ushort start;
+		ushort end;
+		std::vector<decoded_t> instructions;
+		block_t* successor[2] = { nullptr, nullptr };
+		unsigned int cycles = 0;
+		unsigned int executions = 0;
+		jitFunction_t* native = nullptr;
+		uchar bank = 0;		//register bank native was translated for
+		unsigned int codeBank = 0;
+		bool idle = false;	//a lone idle loop instruction
+		bool delay = false;	//a lone delay loop instruction
+	};
+	void executeBlocks(unsigned long instructions);
+	block_t* lookupBlock(ushort address);
+	block_t* nextBlock(block_t* block);
+	static bool isBranch(uchar opcode);
+	bool translateBlock(block_t* block);
+	void executeRecompiled(unsigned long instructions);
+	unsigned int imageChecksum();
 	
 	void setPSW_C(uchar b);		//Set Carry
 	void setPSW_AC(uchar b);		//Set Auxilary Carry
@@ -151,313 +421,323 @@ private:
 
 	ushort getDPTR();
 	void setDPTR(ushort a);
+
+	//Lazy flags: ADD, ADDC and SUBB record their operands instead of
+	//updating C, AC and OV. syncPSW() brings hot.psw up to date before
+	//anything reads or modifies it; P is always derived from A on read.
+	//peekPSW() works the same value out without storing it, for getters
+	//that may run on another thread than the emulation.
+	enum class flags_t : uchar { valid, add, subb };
+	static uchar lazyFlags(flags_t op, uchar a, uchar value, uchar carry);
+	void syncPSW();
+	uchar readPSW();
+	uchar peekPSW() const;
+
+	//Registers used by nearly every instruction, kept together in one
+	//cache line instead of in the SFR image. Direct and bit accesses to
+	//their SFR addresses are redirected here, and syncSFR() copies them
+	//into sfr when a run returns.
+	struct alignas(64) registers_t {
+		ushort pc = 0;
+		uchar a = 0;
+		uchar psw = 0;
+		uchar sp = 0;
+		uchar bank = 0;		//address of R0, follows RS1:RS0 on every PSW write
+		flags_t flagsOp = flags_t::valid;
+		uchar flagsA = 0;
+		uchar flagsValue = 0;
+		uchar flagsCarry = 0;
+		ushort dptr = 0;	//apart from pc so their updates are not merged into one store
+	};
+	uchar readSFR(uchar address);
+	void writeSFR(uchar address, uchar value);
+	void syncSFR();
+	void selectCodeBank(unsigned int bank);
+
+	//Scheduler. eventQueue is a min-heap of (deadline, id) pairs. An entry
+	//whose deadline no longer matches its event's was rescheduled or
+	//cancelled and is dropped when it reaches the top. The engines only
+	//compare cycles with nextEvent, the earliest deadline in the queue.
+	static constexpr unsigned long long never = ~0ull;
+	struct event_t {
+		void (cpu::* member)() = nullptr;	//cpu's own peripherals
+		eventHandler_t* handler = nullptr;
+		void* context = nullptr;
+		unsigned long long deadline = never;
+	};
+	int addEvent(void (cpu::* member)());
+	bool isScheduled(int id) {
+		return events[id].deadline != never;
+	}
+	void runEvents();
+
+	//Timer 0/1, brought up to date only when a timer SFR is accessed or an
+	//overflow falls due. syncTimers() adds the machine cycles elapsed since
+	//timersSynced in one step per counter, and scheduleTimers() syncs and
+	//arms timerEvent for the next overflow that would set TF0 or TF1.
+	//countTimers() does the counting on a copy, which the getters use to
+	//peek at the timers without changing any state.
+	static constexpr bool isTimerSFR(uchar address) {
+		return address == tcon || address == tmod || address == tl0 ||
+			address == tl1 || address == th0 || address == th1;
+	}
+	struct timers_t {
+		uchar control;
+		uchar high0;
+		uchar low0;
+		uchar high1;
+		uchar low1;
+	};
+	timers_t countTimers(unsigned long long elapsed) const;
+	timers_t peekTimers() const;
+	void syncTimers();
+	void scheduleTimers();
+	void timerOverflow();
+
+	//Interrupt controller. interruptPending has a bit per source in polling
+	//order (IE0, TF0, IE1, TF1, RI/TI) that is requested, enabled and not
+	//masked by the level in service; it is recomputed whenever one of those
+	//changes. While it is non-zero nextEvent is held at or below
+	//interruptsFrom, so the engines' event check is the only test on the
+	//instruction path. inService has bit 0 set while a low priority handler
+	//runs and bit 1 for a high priority one.
+	static constexpr bool isInterruptSFR(uchar address) {
+		return address == tcon || address == scon || address == ie || address == ip;
+	}
+	void updateInterrupts();
+	void vectorInterrupt();
+
+	//Serial port. A byte written to SBUF takes one frame at the rate of the
+	//mode in SCON to shift out, then TI is set and the byte is pushed to
+	//serialOutput. SBUF reads return the receive buffer kept in sfr[], which
+	//receiveEvent fills from serialInput once per frame while the receiver
+	//is ready and bytes are waiting.
+	void startTransmit(uchar value);
+	unsigned long long frameCycles();
+	void transmitDone();
+	void scheduleReceive();
+	void receiveDone();
+
+	//Registered SFR hooks, indexed by address - sfr_base. The bitmaps have
+	//a bit set per hooked address so unhooked accesses cost a single test.
+	struct sfrHook_t {
+		sfrReadHook_t* read = nullptr;
+		sfrWriteHook_t* write = nullptr;
+		void* readContext = nullptr;
+		void* writeContext = nullptr;
+	};
+	static constexpr bool isHotSFR(uchar address) {
+		return address == acc || address == psw || address == sp ||
+			address == dpl || address == dph;
+	}
+	static bool isHooked(const unsigned long long* bitmap, uchar address) {
+		uchar index = address - sfr_base;
+		return (bitmap[index >> 6] >> (index & 63)) & 1;
+	}
+	void updateSFRHooked(uchar address);
+	void catchUp(uchar address);
+	uchar readHooked(uchar address);
+	void writeHooked(uchar address, uchar value);
 //Members
 private:
-	static cpu* instance;
-
 	//general purpose registers memory map
-	const uchar r0 = 0x00;
-	const uchar r1 = 0x01;
-	const uchar r2 = 0x02;
-	const uchar r3 = 0x03;
-	const uchar r4 = 0x04;
-	const uchar r5 = 0x05;
-	const uchar r6 = 0x06;
-	const uchar r7 = 0x07;
-	const uchar stack_start = 0x08;
-	const uchar bit_addressable_area = 0x20;
-	const uchar scratch_pad_start = 0x30;
-
-	//special function regiesters (SFR) memory map
-	const uchar p0		= 0x80;		//PORT 0 latch
-	const uchar sp		= 0x81;		//stack pointer
-	const uchar dpl		= 0x82;		//addressing external memory
-	const uchar dph		= 0x83;		//addressing external memory
-	const uchar pcon	= 0x87;		//power control
-	const uchar tcon	= 0x88;		//time/counter control
-	const uchar tmod	= 0x89;		//timer/counter mode control
-	const uchar tl0		= 0x8A;		//timer 0 LOW byte
-	const uchar tl1		= 0x8B;		//timer 1 LOW byte
-	const uchar th0		= 0x8C;		//timer 0 HIGH byte
-	const uchar th1		= 0x8D;		//timer 1 HIGH byte
-	const uchar p1		= 0x90;		//PORT 1 latch
-	const uchar scon	= 0x98;		//serial port control
-	const uchar sbuf	= 0x99;		//serial port data buffer
-	const uchar p2		= 0xA0;		//PORT 2 latch
-	const uchar ie		= 0xA8;		//interrupt enable control
-	const uchar p3		= 0xB0;		//PORT 3 latch
-	const uchar ip		= 0xB8;		//interrupt priority
-	const uchar psw		= 0xD0;		//program status word
-	const uchar acc		= 0xE0;		//accumulator
-	const uchar b		= 0xF0;		//b register for arithmetic
-
-	//opcode handlers
+	static constexpr uchar r0 = 0x00;
+	static constexpr uchar r1 = 0x01;
+	static constexpr uchar r2 = 0x02;
+	static constexpr uchar r3 = 0x03;
+	static constexpr uchar r4 = 0x04;
+	static constexpr uchar r5 = 0x05;
+	static constexpr uchar r6 = 0x06;
+	static constexpr uchar r7 = 0x07;
+	static constexpr uchar stack_start = 0x08;
+	static constexpr uchar bit_addressable_area = 0x20;
+	static constexpr uchar scratch_pad_start = 0x30;
+
+	//special function regiesters (SFR) memory map, sfr[] holds 0x80-0xFF
+	static constexpr uchar sfr_base	= 0x80;
+	static constexpr uchar p0		= 0x80;		//PORT 0 latch
+	static constexpr uchar sp		= 0x81;		//stack pointer
+	static constexpr uchar dpl		= 0x82;		//addressing external memory
+	static constexpr uchar dph		= 0x83;		//addressing external memory
+	static constexpr uchar pcon	= 0x87;		//power control
+	static constexpr uchar tcon	= 0x88;		//time/counter control
+	static constexpr uchar tmod	= 0x89;		//timer/counter mode control
+	static constexpr uchar tl0		= 0x8A;		//timer 0 LOW byte
+	static constexpr uchar tl1		= 0x8B;		//timer 1 LOW byte
+	static constexpr uchar th0		= 0x8C;		//timer 0 HIGH byte
+	static constexpr uchar th1		= 0x8D;		//timer 1 HIGH byte
+	static constexpr uchar p1		= 0x90;		//PORT 1 latch
+	static constexpr uchar scon	= 0x98;		//serial port control
+	static constexpr uchar sbuf	= 0x99;		//serial port data buffer
+	static constexpr uchar p2		= 0xA0;		//PORT 2 latch
+	static constexpr uchar ie		= 0xA8;		//interrupt enable control
+	static constexpr uchar p3		= 0xB0;		//PORT 3 latch
+	static constexpr uchar ip		= 0xB8;		//interrupt priority
+	static constexpr uchar psw		= 0xD0;		//program status word
+	static constexpr uchar acc		= 0xE0;		//accumulator
+	static constexpr uchar b		= 0xF0;		//b register for arithmetic
+
+	//TCON run, overflow and external interrupt flags
+	static constexpr uchar tcon_tf1 = 0x80;
+	static constexpr uchar tcon_tr1 = 0x40;
+	static constexpr uchar tcon_tf0 = 0x20;
+	static constexpr uchar tcon_tr0 = 0x10;
+	static constexpr uchar tcon_ie1 = 0x08;	//INT1 requested
+	static constexpr uchar tcon_it1 = 0x04;	//INT1 falling edge triggered
+	static constexpr uchar tcon_ie0 = 0x02;
+	static constexpr uchar tcon_it0 = 0x01;
+
+	//SCON flags, the mode is in the top two bits. SMOD in PCON doubles
+	//the rate of modes 1 to 3.
+	static constexpr uchar scon_ren = 0x10;
+	static constexpr uchar scon_rb8 = 0x04;
+	static constexpr uchar scon_ti = 0x02;
+	static constexpr uchar scon_ri = 0x01;
+	static constexpr uchar pcon_smod = 0x80;
+
+	//INT0 and INT1 in P3
+	static constexpr uchar p3_int0 = 0x04;
+	static constexpr uchar p3_int1 = 0x08;
+
+	//operand access shared by the handler templates
+	template<addressing_t M, uchar N> uchar load(uchar operand);
+	template<addressing_t M, uchar N> void store(uchar operand, uchar value);
+	bool getBit(uchar bit);
+	void setBit(uchar bit, bool value);
+	void push(uchar value);
+	uchar pop();
+	void add(uchar value, uchar carry);
+	void subb(uchar value, uchar carry);
+
+	enum class alu_t { orl, anl, xrl };
+
+	//opcode handlers, instantiated through the isa table
 	std::vector<opcodeHandler_t> opcodeHandler;
-	void opcode_00();
-	void opcode_01();
-	void opcode_02();
-	void opcode_03();
-	void opcode_04();
-	void opcode_05();
-	void opcode_06();
-	void opcode_07();
-	void opcode_08();
-	void opcode_09();
-	void opcode_0A();
-	void opcode_0B();
-	void opcode_0C();
-	void opcode_0D();
-	void opcode_0E();
-	void opcode_0F();
-	void opcode_10();
-	void opcode_11();
-	void opcode_12();
-	void opcode_13();
-	void opcode_14();
-	void opcode_15();
-	void opcode_16();
-	void opcode_17();
-	void opcode_18();
-	void opcode_19();
-	void opcode_1A();
-	void opcode_1B();
-	void opcode_1C();
-	void opcode_1D();
-	void opcode_1E();
-	void opcode_1F();
-	void opcode_20();
-	void opcode_21();
-	void opcode_22();
-	void opcode_23();
-	void opcode_24();
-	void opcode_25();
-	void opcode_26();
-	void opcode_27();
-	void opcode_28();
-	void opcode_29();
-	void opcode_2A();
-	void opcode_2B();
-	void opcode_2C();
-	void opcode_2D();
-	void opcode_2E();
-	void opcode_2F();
-	void opcode_30();
-	void opcode_31();
-	void opcode_32();
-	void opcode_33();
-	void opcode_34();
-	void opcode_35();
-	void opcode_36();
-	void opcode_37();
-	void opcode_38();
-	void opcode_39();
-	void opcode_3A();
-	void opcode_3B();
-	void opcode_3C();
-	void opcode_3D();
-	void opcode_3E();
-	void opcode_3F();
-	void opcode_40();
-	void opcode_41();
-	void opcode_42();
-	void opcode_43();
-	void opcode_44();
-	void opcode_45();
-	void opcode_46();
-	void opcode_47();
-	void opcode_48();
-	void opcode_49();
-	void opcode_4A();
-	void opcode_4B();
-	void opcode_4C();
-	void opcode_4D();
-	void opcode_4E();
-	void opcode_4F();
-	void opcode_50();
-	void opcode_51();
-	void opcode_52();
-	void opcode_53();
-	void opcode_54();
-	void opcode_55();
-	void opcode_56();
-	void opcode_57();
-	void opcode_58();
-	void opcode_59();
-	void opcode_5A();
-	void opcode_5B();
-	void opcode_5C();
-	void opcode_5D();
-	void opcode_5E();
-	void opcode_5F();
-	void opcode_60();
-	void opcode_61();
-	void opcode_62();
-	void opcode_63();
-	void opcode_64();
-	void opcode_65();
-	void opcode_66();
-	void opcode_67();
-	void opcode_68();
-	void opcode_69();
-	void opcode_6A();
-	void opcode_6B();
-	void opcode_6C();
-	void opcode_6D();
-	void opcode_6E();
-	void opcode_6F();
-	void opcode_70();
-	void opcode_71();
-	void opcode_72();
-	void opcode_73();
-	void opcode_74();
-	void opcode_75();
-	void opcode_76();
-	void opcode_77();
-	void opcode_78();
-	void opcode_79();
-	void opcode_7A();
-	void opcode_7B();
-	void opcode_7C();
-	void opcode_7D();
-	void opcode_7E();
-	void opcode_7F();
-	void opcode_80();
-	void opcode_81();
-	void opcode_82();
-	void opcode_83();
-	void opcode_84();
-	void opcode_85();
-	void opcode_86();
-	void opcode_87();
-	void opcode_88();
-	void opcode_89();
-	void opcode_8A();
-	void opcode_8B();
-	void opcode_8C();
-	void opcode_8D();
-	void opcode_8E();
-	void opcode_8F();
-	void opcode_90();
-	void opcode_91();
-	void opcode_92();
-	void opcode_93();
-	void opcode_94();
-	void opcode_95();
-	void opcode_96();
-	void opcode_97();
-	void opcode_98();
-	void opcode_99();
-	void opcode_9A();
-	void opcode_9B();
-	void opcode_9C();
-	void opcode_9D();
-	void opcode_9E();
-	void opcode_9F();
-	void opcode_A0();
-	void opcode_A1();
-	void opcode_A2();
-	void opcode_A3();
-	void opcode_A4();
-	void opcode_A5();
-	void opcode_A6();
-	void opcode_A7();
-	void opcode_A8();
-	void opcode_A9();
-	void opcode_AA();
-	void opcode_AB();
-	void opcode_AC();
-	void opcode_AD();
-	void opcode_AE();
-	void opcode_AF();
-	void opcode_B0();
-	void opcode_B1();
-	void opcode_B2();
-	void opcode_B3();
-	void opcode_B4();
-	void opcode_B5();
-	void opcode_B6();
-	void opcode_B7();
-	void opcode_B8();
-	void opcode_B9();
-	void opcode_BA();
-	void opcode_BB();
-	void opcode_BC();
-	void opcode_BD();
-	void opcode_BE();
-	void opcode_BF();
-	void opcode_C0();
-	void opcode_C1();
-	void opcode_C2();
-	void opcode_C3();
-	void opcode_C4();
-	void opcode_C5();
-	void opcode_C6();
-	void opcode_C7();
-	void opcode_C8();
-	void opcode_C9();
-	void opcode_CA();
-	void opcode_CB();
-	void opcode_CC();
-	void opcode_CD();
-	void opcode_CE();
-	void opcode_CF();
-	void opcode_D0();
-	void opcode_D1();
-	void opcode_D2();
-	void opcode_D3();
-	void opcode_D4();
-	void opcode_D5();
-	void opcode_D6();
-	void opcode_D7();
-	void opcode_D8();
-	void opcode_D9();
-	void opcode_DA();
-	void opcode_DB();
-	void opcode_DC();
-	void opcode_DD();
-	void opcode_DE();
-	void opcode_DF();
-	void opcode_E0();
-	void opcode_E1();
-	void opcode_E2();
-	void opcode_E3();
-	void opcode_E4();
-	void opcode_E5();
-	void opcode_E6();
-	void opcode_E7();
-	void opcode_E8();
-	void opcode_E9();
-	void opcode_EA();
-	void opcode_EB();
-	void opcode_EC();
-	void opcode_ED();
-	void opcode_EE();
-	void opcode_EF();
-	void opcode_F0();
-	void opcode_F1();
-	void opcode_F2();
-	void opcode_F3();
-	void opcode_F4();
-	void opcode_F5();
-	void opcode_F6();
-	void opcode_F7();
-	void opcode_F8();
-	void opcode_F9();
-	void opcode_FA();
-	void opcode_FB();
-	void opcode_FC();
-	void opcode_FD();
-	void opcode_FE();
-	void opcode_FF();
-
-	//Memory
+	void op_nop(uchar, uchar);
+	template<uchar PAGE> void op_ajmp(uchar op1, uchar);
+	template<uchar PAGE> void op_acall(uchar op1, uchar);
+	void op_ljmp(uchar op1, uchar op2);
+	void op_lcall(uchar op1, uchar op2);
+	void op_ret(uchar, uchar);
+	void op_reti(uchar, uchar);
+	void op_sjmp(uchar op1, uchar);
+	void op_jmp(uchar, uchar);
+	void op_jc(uchar op1, uchar);
+	void op_jnc(uchar op1, uchar);
+	void op_jz(uchar op1, uchar);
+	void op_jnz(uchar op1, uchar);
+	template<bool SET, bool CLEAR> void op_jbit(uchar op1, uchar op2);
+	template<addressing_t D, addressing_t S, uchar N> void op_cjne(uchar op1, uchar op2);
+	template<addressing_t M, uchar N> void op_djnz(uchar op1, uchar op2);
+
+	void op_rr(uchar, uchar);
+	void op_rrc(uchar, uchar);
+	void op_rl(uchar, uchar);
+	void op_rlc(uchar, uchar);
+	void op_swap(uchar, uchar);
+	void op_clr_a(uchar, uchar);
+	void op_cpl_a(uchar, uchar);
+	void op_da(uchar, uchar);
+	void op_mul(uchar, uchar);
+	void op_div(uchar, uchar);
+	template<addressing_t M, uchar N> void op_inc(uchar op1, uchar);
+	template<addressing_t M, uchar N> void op_dec(uchar op1, uchar);
+	void op_inc_dptr(uchar, uchar);
+	template<addressing_t M, uchar N> void op_add(uchar op1, uchar);
+	template<addressing_t M, uchar N> void op_addc(uchar op1, uchar);
+	template<addressing_t M, uchar N> void op_subb(uchar op1, uchar);
+	template<alu_t OP, addressing_t D, addressing_t S, uchar N> void op_logic(uchar op1, uchar op2);
+
+	void op_clr_c(uchar, uchar);
+	void op_setb_c(uchar, uchar);
+	void op_cpl_c(uchar, uchar);
+	void op_clr_bit(uchar op1, uchar);
+	void op_setb_bit(uchar op1, uchar);
+	void op_cpl_bit(uchar op1, uchar);
+	template<bool INVERT> void op_anl_c(uchar op1, uchar);
+	template<bool INVERT> void op_orl_c(uchar op1, uchar);
+	void op_mov_c_bit(uchar op1, uchar);
+	void op_mov_bit_c(uchar op1, uchar);
+
+	template<addressing_t D, addressing_t S, uchar N> void op_mov(uchar op1, uchar op2);
+	void op_mov_dptr(uchar op1, uchar op2);
+	void op_movc_pc(uchar, uchar);
+	void op_movc_dptr(uchar, uchar);
+	template<bool WRITE, addressing_t M, uchar N> void op_movx(uchar, uchar);
+	void op_push(uchar op1, uchar);
+	void op_pop(uchar op1, uchar);
+	template<addressing_t M, uchar N> void op_xch(uchar op1, uchar);
+	template<uchar N> void op_xchd(uchar, uchar);
+	template<uchar... OPS> void op_fused(uchar op1, uchar op2);
+
+	//Memory. ram is the 256 byte IDATA space, reached directly below 0x80
+	//and indirectly everywhere; direct addresses from 0x80 go to sfr. rom and
+	//xram span the full 16-bit CODE and XDATA spaces, so any ushort address
+	//indexes them without a bounds check.
 	uchar ram[RAM_SIZE];
-	uchar rom[ROM_SIZE];
-	ushort pc;
+	uchar sfr[SFR_SIZE];
+	const uchar* rom = nullptr;		//the selected bank in image->code
+	uchar xram[XRAM_SIZE];
+	unsigned int codeEnd = 0;	//one past the highest address the image loaded
+	registers_t hot;
+	unsigned long long cycles = 0;
+	unsigned long oscillator = DEFAULT_OSCILLATOR_HZ;
+	unsigned int clocksPerMachineCycle = DEFAULT_CLOCKS_PER_CYCLE;
+	std::shared_ptr<const image_t> image;
+	std::vector<std::unique_ptr<block_t>> blocks;	//laid out like image->decoded
+	executableMemory jitMemory;
+
+	//Code banking. Selecting a bank only repoints the window pointers
+	//below, nothing is flushed or decoded again. The decoded windows end
+	//at decodedEnd.
+	const decoded_t* decodedWindow = nullptr;
+	const decoded_t* fusedWindow = nullptr;
+	std::unique_ptr<block_t>* blocksWindow = nullptr;
+	unsigned int decodedEnd = 0;
+	unsigned int codeBanks = 1;
+	unsigned int codeBank = 0;
+	uchar codeBankSelect = 0;	//SFR address, 0 while banking is off
+	uchar codeBankMask = 0;
+	uchar codeBankShift = 0;
+	ushort codeBankWindow = 0;
+
+	engine_t engine = CPU_DEFAULT_ENGINE;
+	bool fusion = CPU_ENABLE_FUSION;
+
+	//Execution counts gathered while profiling. Bigrams are indexed by
+	//previous opcode * 256 + opcode; previous starts at OPCODES_SIZE so the
+	//first instruction of a run lands in a row the report skips.
+	struct profile_t {
+		unsigned long long opcodes[OPCODES_SIZE] = {};
+		unsigned long long bigrams[(OPCODES_SIZE + 1) * OPCODES_SIZE] = {};
+		unsigned int previous = OPCODES_SIZE;
+	};
+	std::unique_ptr<profile_t> profile;
+
+	std::vector<event_t> events;
+	std::vector<std::pair<unsigned long long, int>> eventQueue;
+	unsigned long long nextEvent = never;
+	unsigned long long timersSynced = 0;
+	int timerEvent = -1;
+	int transmitEvent = -1;
+	uchar transmitting = 0;
+	int receiveEvent = -1;
+	std::unique_ptr<ring_t<SERIAL_RING_SIZE>> serialOutput = std::make_unique<ring_t<SERIAL_RING_SIZE>>();
+	std::unique_ptr<ring_t<SERIAL_RING_SIZE>> serialInput = std::make_unique<ring_t<SERIAL_RING_SIZE>>();
+	unsigned long long serialDropped = 0;
+	uchar interruptPending = 0;
+	uchar inService = 0;
+	unsigned long long interruptsFrom = 0;	//after RETI or an IE/IP write one more instruction runs
+
+	sfrHook_t sfrHooks[SFR_SIZE];
+	unsigned long long sfrReadHooked[SFR_SIZE / 64] = {};
+	unsigned long long sfrWriteHooked[SFR_SIZE / 64] = {};
 
 	//Callback
-	void* callbackFunc;
-	void* client;
-	bool stop = false;
+	callBackForEveryCycle_t* callbackFunc = nullptr;
+	void* client = nullptr;
+	//set by stopEmulation() from another thread, behind a pointer so cpu stays movable
+	std::unique_ptr<std::atomic<bool>> stop = std::make_unique<std::atomic<bool>>(false);
+	bool realTime = false;
 };
 
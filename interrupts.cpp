@@ -0,0 +1,99 @@
+#include "cpu.h"
+#include <algorithm>
+
+//IE and IP have one bit per source in the same order as interruptPending
+static constexpr uchar ie_ea = 0x80;
+static constexpr uchar ie_sources = 0x1F;
+
+//Vector of the source at bit n of interruptPending
+static constexpr ushort vectorAddress(int source)
+{
+	return (ushort)(0x03 + 8 * source);
+}
+
+void cpu::updateInterrupts()
+{
+	uchar control = sfr[tcon - sfr_base];
+	uchar enable = sfr[ie - sfr_base];
+	uchar requests = ((control & tcon_ie0) ? 0x01 : 0) | ((control & tcon_tf0) ? 0x02 : 0) |
+		((control & tcon_ie1) ? 0x04 : 0) | ((control & tcon_tf1) ? 0x08 : 0) |
+		((sfr[scon - sfr_base] & (scon_ri | scon_ti)) ? 0x10 : 0);
+
+	uchar pending = (enable & ie_ea) ? requests & enable & ie_sources : 0;
+	if (inService & 2) {
+		pending = 0;
+	}
+	else if (inService & 1) {
+		pending &= sfr[ip - sfr_base];
+	}
+	interruptPending = pending;
+	if (pending != 0) {
+		nextEvent = std::min(nextEvent, interruptsFrom);
+	}
+}
+
+//Runs from runEvents(). The hardware LCALL to the vector takes two machine
+//cycles; TF0/TF1 and edge triggered IE0/IE1 are cleared as it is taken,
+//RI and TI are left for the handler.
+void cpu::vectorInterrupt()
+{
+	uchar high = interruptPending & sfr[ip - sfr_base];
+	uchar candidates = high != 0 ? high : interruptPending;
+	int source = 0;
+	while (!((candidates >> source) & 1)) {
+		++source;
+	}
+
+	push(hot.pc & 0xFF);
+	push(hot.pc >> 8);
+	hot.pc = vectorAddress(source);
+	cycles += 2;
+	inService |= high != 0 ? 2 : 1;
+
+	syncTimers();
+	uchar& control = sfr[tcon - sfr_base];
+	switch (source) {
+	case 0:
+		if (control & tcon_it0) {
+			control &= ~tcon_ie0;
+		}
+		break;
+	case 1:
+		control &= ~tcon_tf0;
+		scheduleTimers();
+		break;
+	case 2:
+		if (control & tcon_it1) {
+			control &= ~tcon_ie1;
+		}
+		break;
+	case 3:
+		control &= ~tcon_tf1;
+		scheduleTimers();
+		break;
+	}
+	interruptsFrom = cycles + 1;
+	updateInterrupts();
+}
+
+void cpu::setInterruptPin(int line, bool high)
+{
+	uchar pin = line == 0 ? p3_int0 : p3_int1;
+	uchar flag = line == 0 ? tcon_ie0 : tcon_ie1;
+	uchar edge = line == 0 ? tcon_it0 : tcon_it1;
+
+	//the pins gate the timers
+	syncTimers();
+	uchar& pins = sfr[p3 - sfr_base];
+	uchar& control = sfr[tcon - sfr_base];
+	bool wasHigh = (pins & pin) != 0;
+	pins = high ? pins | pin : pins & ~pin;
+	if (!(control & edge)) {
+		control = high ? control & ~flag : control | flag;
+	}
+	else if (wasHigh && !high) {
+		control |= flag;
+	}
+	scheduleTimers();
+	updateInterrupts();
+}
@@ -0,0 +1,528 @@
+#include "cpu.h"
+#include <cstring>
+#include <initializer_list>
+
+#if CPU_ENABLE_JIT
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+executableMemory::executableMemory(executableMemory&& other) noexcept
+	: memory(other.memory), used(other.used)
+{
+	other.memory = nullptr;
+	other.used = 0;
+}
+
+executableMemory& executableMemory::operator=(executableMemory&& other) noexcept
+{
+	if (this != &other) {
+		release();
+		memory = other.memory;
+		used = other.used;
+		other.memory = nullptr;
+		other.used = 0;
+	}
+	return *this;
+}
+
+executableMemory::~executableMemory()
+{
+	release();
+}
+
+void executableMemory::release()
+{
+#if CPU_ENABLE_JIT
+	if (memory != nullptr) {
+#ifdef _WIN32
+		VirtualFree(memory, 0, MEM_RELEASE);
+#else
+		munmap(memory, JIT_CODE_SIZE);
+#endif
+	}
+#endif
+	memory = nullptr;
+	used = 0;
+}
+
+void executableMemory::reset()
+{
+	used = 0;
+}
+
+//Copies code into the block and returns it as a callable function, or
+//nullptr once the block is full.
+jitFunction_t* executableMemory::commit(const uchar* code, size_t size)
+{
+#if CPU_ENABLE_JIT
+	if (memory == nullptr) {
+#ifdef _WIN32
+		memory = (uchar*)VirtualAlloc(nullptr, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+		void* mapped = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		memory = mapped == MAP_FAILED ? nullptr : (uchar*)mapped;
+#endif
+		if (memory == nullptr) {
+			return nullptr;
+		}
+	}
+	if (used + size > JIT_CODE_SIZE) {
+		return nullptr;
+	}
+
+#ifdef _WIN32
+	DWORD old;
+	VirtualProtect(memory, JIT_CODE_SIZE, PAGE_READWRITE, &old);
+	memcpy(memory + used, code, size);
+	VirtualProtect(memory, JIT_CODE_SIZE, PAGE_EXECUTE_READ, &old);
+	FlushInstructionCache(GetCurrentProcess(), memory + used, size);
+#else
+	mprotect(memory, JIT_CODE_SIZE, PROT_READ | PROT_WRITE);
+	memcpy(memory + used, code, size);
+	mprotect(memory, JIT_CODE_SIZE, PROT_READ | PROT_EXEC);
+#endif
+	auto function = (jitFunction_t*)(memory + used);
+	used += (size + 15) & ~(size_t)15;
+	return function;
+#else
+	(void)code;
+	(void)size;
+	return nullptr;
+#endif
+}
+
+#if CPU_ENABLE_JIT
+namespace {
+
+//x86-64 general purpose register numbers
+enum hostRegister_t {
+	RAX = 0, RCX = 1, RDX = 2,
+	R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14,
+};
+
+//Host register assignment inside a translated region. Only registers that
+//are volatile in both the System V and Win64 conventions are used without
+//saving; r12-r14 are pushed by the prologue.
+const int regA = R8;		//accumulator (byte)
+const int regPSW = R9;		//program status word (byte)
+const int regRAM = R10;		//internal RAM / SFR base
+const int regContext = R11;	//jitContext_t*
+const int regDPTR = R12;	//data pointer (word, zero extended)
+const int regSP = R13;		//stack pointer (byte)
+const int regXRAM = R14;	//external RAM base
+const int regBudget = RCX;	//instructions left
+
+//x86 ALU group numbers, used both as /digit and as opcode base
+enum hostAlu_t { ADD = 0, OR = 1, ADC = 2, SBB = 3, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+
+//x86 condition codes
+enum hostCondition_t { CC_B = 0x2, CC_Z = 0x4, CC_NZ = 0x5 };
+
+class x64Emitter
+{
+public:
+	std::vector<uchar> code;
+
+	void bytes(std::initializer_list<uchar> list) {
+		code.insert(code.end(), list);
+	}
+
+	void dword(unsigned int value) {
+		for (int i = 0; i < 4; ++i) {
+			code.push_back((value >> (i * 8)) & 0xFF);
+		}
+	}
+
+	//[REX] opcode ModRM with a register operand in rm
+	void reg(std::initializer_list<uchar> opcode, int reg, int rm, bool wide = false) {
+		rex(wide, reg, 0, rm);
+		bytes(opcode);
+		code.push_back(0xC0 | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	//[REX] opcode ModRM disp with a [base + disp] operand. base must not be
+	//rsp/r12 or rbp/r13, which need a SIB byte or a displacement form.
+	void mem(std::initializer_list<uchar> opcode, int reg, int base, int disp, bool wide = false) {
+		rex(wide, reg, 0, base);
+		bytes(opcode);
+		if (disp >= -128 && disp <= 127) {
+			code.push_back(0x40 | ((reg & 7) << 3) | (base & 7));
+			code.push_back((uchar)disp);
+		}
+		else {
+			code.push_back(0x80 | ((reg & 7) << 3) | (base & 7));
+			dword(disp);
+		}
+	}
+
+	//[REX] opcode ModRM SIB with a [base + index] operand
+	void indexed(std::initializer_list<uchar> opcode, int reg, int base, int index) {
+		rex(false, reg, index, base);
+		bytes(opcode);
+		code.push_back(((reg & 7) << 3) | 0x04);
+		code.push_back(((index & 7) << 3) | (base & 7));
+	}
+
+	//Conditional or unconditional rel32 jump, returns the offset to patch
+	size_t jump(int condition = -1) {
+		if (condition < 0) {
+			code.push_back(0xE9);
+		}
+		else {
+			bytes({ 0x0F, (uchar)(0x80 | condition) });
+		}
+		dword(0);
+		return code.size() - 4;
+	}
+
+	void patch(size_t at, size_t target) {
+		unsigned int rel = (unsigned int)(target - (at + 4));
+		for (int i = 0; i < 4; ++i) {
+			code[at + i] = (rel >> (i * 8)) & 0xFF;
+		}
+	}
+
+private:
+	void rex(bool wide, int reg, int index, int base) {
+		if (wide || reg >= 8 || index >= 8 || base >= 8) {
+			code.push_back(0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+		}
+	}
+};
+
+}
+#endif
+
+//Translates a hot block into native code. Only instructions that touch A,
+//PSW, DPTR, the register file and plain internal RAM are supported; any
+//block containing something else, such as an SFR access with side effects,
+//stays with the interpreter. A block whose branch leads back to its own
+//start loops natively until the budget runs out. Rn is addressed in the
+//register bank selected at translation time, and the native code is only
+//entered while that bank is selected.
+bool cpu::translateBlock(block_t* block)
+{
+#if CPU_ENABLE_JIT
+	x64Emitter x;
+	uchar bank = hot.bank;
+	std::vector<std::pair<size_t, ushort>> exits;
+
+	auto exitTo = [&](int condition, ushort target) {
+		exits.emplace_back(x.jump(condition), target);
+	};
+	auto plainRam = [](uchar address) {
+		return address < 0x80;
+	};
+
+	//prologue
+	x.bytes({ 0x41, 0x54, 0x41, 0x55, 0x41, 0x56 });	//push r12, r13, r14
+#ifdef _WIN32
+	x.reg({ 0x89 }, RCX, regContext, true);		//mov r11, rcx
+#else
+	x.reg({ 0x89 }, 7, regContext, true);		//mov r11, rdi
+#endif
+	x.mem({ 0x8B }, regRAM, regContext, offsetof(jitContext_t, ram), true);
+	x.mem({ 0x8B }, regXRAM, regContext, offsetof(jitContext_t, xram), true);
+	x.mem({ 0x8B }, regBudget, regContext, offsetof(jitContext_t, budget), true);
+	x.mem({ 0x8B }, RDX, regContext, offsetof(jitContext_t, registers), true);
+	x.mem({ 0x0F, 0xB6 }, regA, RDX, offsetof(registers_t, a));
+	x.mem({ 0x0F, 0xB6 }, regPSW, RDX, offsetof(registers_t, psw));
+	x.mem({ 0x0F, 0xB6 }, regSP, RDX, offsetof(registers_t, sp));
+	x.mem({ 0x0F, 0xB7 }, regDPTR, RDX, offsetof(registers_t, dptr));
+
+	//loop head: leave if a whole pass no longer fits in the budget
+	size_t loop = x.code.size();
+	auto count = (unsigned int)block->instructions.size();
+	x.reg({ 0x81 }, CMP, regBudget, true);
+	x.dword(count);
+	exitTo(CC_B, block->start);
+	x.reg({ 0x81 }, SUB, regBudget, true);
+	x.dword(count);
+
+	auto branchTo = [&](int condition, ushort target) {
+		if (target == block->start) {
+			x.patch(x.jump(condition), loop);
+		}
+		else {
+			exitTo(condition, target);
+		}
+	};
+
+	//A <op>= operand, for the ALU opcodes laid out as #data, direct, @Ri, Rn
+	auto aluA = [&](int op, const decoded_t& instruction) {
+		uchar low = instruction.opcode & 0x0F;
+		if (low == 0x04) {
+			x.reg({ 0x80 }, op, regA);
+			x.code.push_back(instruction.op1);
+			return true;
+		}
+		if (low == 0x05 && plainRam(instruction.op1)) {
+			x.mem({ (uchar)((op << 3) | 2) }, regA, regRAM, instruction.op1);
+			return true;
+		}
+		if (low >= 0x08) {
+			x.mem({ (uchar)((op << 3) | 2) }, regA, regRAM, bank + (low & 0x07));
+			return true;
+		}
+		return false;
+	};
+
+	//copies the x86 CF, AF and OF left by ADD/ADC/SBB into PSW C, AC and OV
+	auto arithmeticFlags = [&]() {
+		x.bytes({ 0x9F });				//lahf
+		x.bytes({ 0x0F, 0x90, 0xC2 });			//seto dl
+		x.reg({ 0x80 }, AND, regPSW);
+		x.code.push_back(0x3B);
+		x.bytes({ 0x88, 0xE0, 0x24, 0x01, 0xC0, 0xE0, 0x07 });	//mov al, ah; and al, 1; shl al, 7
+		x.reg({ 0x08 }, RAX, regPSW);			//or r9b, al
+		x.bytes({ 0x88, 0xE0, 0x24, 0x10, 0xC0, 0xE0, 0x02 });	//mov al, ah; and al, 0x10; shl al, 2
+		x.reg({ 0x08 }, RAX, regPSW);
+		x.bytes({ 0xC0, 0xE2, 0x02 });			//shl dl, 2
+		x.reg({ 0x08 }, RDX, regPSW);			//or r9b, dl
+	};
+	auto carryIn = [&]() {
+		x.reg({ 0x0F, 0xBA }, 4, regPSW);		//bt r9d, 7
+		x.code.push_back(7);
+	};
+
+	bool branched = false;
+	ushort next = block->start;
+	for (auto& instruction : block->instructions) {
+		uchar opcode = instruction.opcode;
+		uchar op1 = instruction.op1;
+		uchar op2 = instruction.op2;
+		next += instruction.length;
+		ushort relative = next + (schar)(opcode == 0xD5 || (opcode & 0xF0) == 0xB0 ? op2 : op1);
+		bool handled = true;
+
+		switch (opcode) {
+		case 0x00:	//NOP
+			break;
+		case 0x04:	//INC A
+			x.reg({ 0xFE }, 0, regA);
+			break;
+		case 0x14:	//DEC A
+			x.reg({ 0xFE }, 1, regA);
+			break;
+		case 0x05:	//INC direct
+		case 0x15:	//DEC direct
+			handled = plainRam(op1);
+			x.mem({ 0xFE }, opcode == 0x05 ? 0 : 1, regRAM, op1);
+			break;
+		case 0x08: case 0x09: case 0x0A: case 0x0B: case 0x0C: case 0x0D: case 0x0E: case 0x0F:
+			x.mem({ 0xFE }, 0, regRAM, bank + (opcode & 0x07));
+			break;
+		case 0x18: case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E: case 0x1F:
+			x.mem({ 0xFE }, 1, regRAM, bank + (opcode & 0x07));
+			break;
+		case 0x03:	//RR A
+			x.reg({ 0xD0 }, 1, regA);
+			break;
+		case 0x23:	//RL A
+			x.reg({ 0xD0 }, 0, regA);
+			break;
+		case 0xC4:	//SWAP A
+			x.reg({ 0xC0 }, 0, regA);
+			x.code.push_back(4);
+			break;
+		case 0xE4:	//CLR A
+			x.reg({ 0x31 }, regA, regA);
+			break;
+		case 0xF4:	//CPL A
+			x.reg({ 0xF6 }, 2, regA);
+			break;
+		case 0xC3:	//CLR C
+			x.reg({ 0x80 }, AND, regPSW);
+			x.code.push_back(0x7F);
+			break;
+		case 0xD3:	//SETB C
+			x.reg({ 0x80 }, OR, regPSW);
+			x.code.push_back(0x80);
+			break;
+		case 0xB3:	//CPL C
+			x.reg({ 0x80 }, XOR, regPSW);
+			x.code.push_back(0x80);
+			break;
+		case 0x74:	//MOV A,#data
+			x.reg({ 0xC6 }, 0, regA);
+			x.code.push_back(op1);
+			break;
+		case 0xE5:	//MOV A,direct
+			handled = plainRam(op1);
+			x.mem({ 0x8A }, regA, regRAM, op1);
+			break;
+		case 0xF5:	//MOV direct,A
+			handled = plainRam(op1);
+			x.mem({ 0x88 }, regA, regRAM, op1);
+			break;
+		case 0x75:	//MOV direct,#data
+			handled = plainRam(op1);
+			x.mem({ 0xC6 }, 0, regRAM, op1);
+			x.code.push_back(op2);
+			break;
+		case 0x85:	//MOV direct,direct (source first)
+			handled = plainRam(op1) && plainRam(op2);
+			x.mem({ 0x8A }, RAX, regRAM, op1);
+			x.mem({ 0x88 }, RAX, regRAM, op2);
+			break;
+		case 0x90:	//MOV DPTR,#data16
+			x.bytes({ 0x41, 0xBC });			//mov r12d, imm32
+			x.dword((op1 << 8) | op2);
+			break;
+		case 0xA3:	//INC DPTR
+			x.code.push_back(0x66);
+			x.reg({ 0xFF }, 0, regDPTR);
+			break;
+		case 0xE0:	//MOVX A,@DPTR
+			x.indexed({ 0x8A }, regA, regXRAM, regDPTR);
+			break;
+		case 0xF0:	//MOVX @DPTR,A
+			x.indexed({ 0x88 }, regA, regXRAM, regDPTR);
+			break;
+		case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A: case 0x2B: case 0x2C: case 0x2D: case 0x2E: case 0x2F:
+			handled = aluA(ADD, instruction);
+			arithmeticFlags();
+			break;
+		case 0x34: case 0x35: case 0x38: case 0x39: case 0x3A: case 0x3B: case 0x3C: case 0x3D: case 0x3E: case 0x3F:
+			carryIn();
+			handled = aluA(ADC, instruction);
+			arithmeticFlags();
+			break;
+		case 0x94: case 0x95: case 0x98: case 0x99: case 0x9A: case 0x9B: case 0x9C: case 0x9D: case 0x9E: case 0x9F:
+			carryIn();
+			handled = aluA(SBB, instruction);
+			arithmeticFlags();
+			break;
+		case 0x44: case 0x45: case 0x48: case 0x49: case 0x4A: case 0x4B: case 0x4C: case 0x4D: case 0x4E: case 0x4F:
+			handled = aluA(OR, instruction);
+			break;
+		case 0x54: case 0x55: case 0x58: case 0x59: case 0x5A: case 0x5B: case 0x5C: case 0x5D: case 0x5E: case 0x5F:
+			handled = aluA(AND, instruction);
+			break;
+		case 0x64: case 0x65: case 0x68: case 0x69: case 0x6A: case 0x6B: case 0x6C: case 0x6D: case 0x6E: case 0x6F:
+			handled = aluA(XOR, instruction);
+			break;
+		case 0x42: case 0x52: case 0x62:	//ORL/ANL/XRL direct,A
+			handled = plainRam(op1);
+			x.mem({ (uchar)(((opcode == 0x42 ? OR : opcode == 0x52 ? AND : XOR) << 3)) }, regA, regRAM, op1);
+			break;
+		case 0xE8: case 0xE9: case 0xEA: case 0xEB: case 0xEC: case 0xED: case 0xEE: case 0xEF:
+			x.mem({ 0x8A }, regA, regRAM, bank + (opcode & 0x07));
+			break;
+		case 0xF8: case 0xF9: case 0xFA: case 0xFB: case 0xFC: case 0xFD: case 0xFE: case 0xFF:
+			x.mem({ 0x88 }, regA, regRAM, bank + (opcode & 0x07));
+			break;
+		case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7E: case 0x7F:
+			x.mem({ 0xC6 }, 0, regRAM, bank + (opcode & 0x07));
+			x.code.push_back(op1);
+			break;
+		case 0xA8: case 0xA9: case 0xAA: case 0xAB: case 0xAC: case 0xAD: case 0xAE: case 0xAF:
+			handled = plainRam(op1);
+			x.mem({ 0x8A }, RAX, regRAM, op1);
+			x.mem({ 0x88 }, RAX, regRAM, bank + (opcode & 0x07));
+			break;
+		case 0x88: case 0x89: case 0x8A: case 0x8B: case 0x8C: case 0x8D: case 0x8E: case 0x8F:
+			handled = plainRam(op1);
+			x.mem({ 0x8A }, RAX, regRAM, bank + (opcode & 0x07));
+			x.mem({ 0x88 }, RAX, regRAM, op1);
+			break;
+		case 0xC8: case 0xC9: case 0xCA: case 0xCB: case 0xCC: case 0xCD: case 0xCE: case 0xCF:
+			x.mem({ 0x86 }, regA, regRAM, bank + (opcode & 0x07));	//xchg [r10+n], r8b
+			break;
+
+		//block terminators
+		case 0x80:	//SJMP
+			branchTo(-1, relative);
+			branched = true;
+			break;
+		case 0x02:	//LJMP
+			branchTo(-1, (op1 << 8) | op2);
+			branched = true;
+			break;
+		case 0x60:	//JZ
+		case 0x70:	//JNZ
+			x.reg({ 0x84 }, regA, regA);			//test r8b, r8b
+			branchTo(opcode == 0x60 ? CC_Z : CC_NZ, relative);
+			break;
+		case 0x40:	//JC
+		case 0x50:	//JNC
+			x.reg({ 0xF6 }, 0, regPSW);			//test r9b, 0x80
+			x.code.push_back(0x80);
+			branchTo(opcode == 0x40 ? CC_NZ : CC_Z, relative);
+			break;
+		case 0xD5:	//DJNZ direct,rel
+			handled = plainRam(op1);
+			x.mem({ 0xFE }, 1, regRAM, op1);
+			branchTo(CC_NZ, relative);
+			break;
+		case 0xD8: case 0xD9: case 0xDA: case 0xDB: case 0xDC: case 0xDD: case 0xDE: case 0xDF:
+			x.mem({ 0xFE }, 1, regRAM, bank + (opcode & 0x07));
+			branchTo(CC_NZ, relative);
+			break;
+		case 0xB4:	//CJNE A,#data,rel
+		case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+			if (opcode == 0xB4) {
+				x.reg({ 0x80 }, CMP, regA);
+			}
+			else {
+				x.mem({ 0x80 }, CMP, regRAM, bank + (opcode & 0x07));
+			}
+			x.code.push_back(op1);
+			x.bytes({ 0x0F, 0x92, 0xC0 });			//setc al
+			x.bytes({ 0x0F, 0x95, 0xC2 });			//setne dl
+			x.reg({ 0x80 }, AND, regPSW);
+			x.code.push_back(0x7F);
+			x.bytes({ 0xC0, 0xE0, 0x07 });			//shl al, 7
+			x.reg({ 0x08 }, RAX, regPSW);			//or r9b, al
+			x.bytes({ 0x84, 0xD2 });			//test dl, dl
+			branchTo(CC_NZ, relative);
+			break;
+		default:
+			if ((opcode & 0x1F) == 0x01) {	//AJMP
+				branchTo(-1, (next & 0xF800) | ((opcode >> 5) << 8) | op1);
+				branched = true;
+				break;
+			}
+			handled = false;
+			break;
+		}
+		if (!handled) {
+			return false;
+		}
+	}
+	if (!branched) {
+		exitTo(-1, block->end);
+	}
+
+	//exits: pc in eax, then store the registers back and return
+	std::vector<size_t> toEpilogue;
+	for (auto& exit : exits) {
+		x.patch(exit.first, x.code.size());
+		x.code.push_back(0xB8);				//mov eax, pc
+		x.dword(exit.second);
+		toEpilogue.push_back(x.jump());
+	}
+	for (auto at : toEpilogue) {
+		x.patch(at, x.code.size());
+	}
+	x.mem({ 0x8B }, RDX, regContext, offsetof(jitContext_t, registers), true);
+	x.mem({ 0x88 }, regA, RDX, offsetof(registers_t, a));
+	x.mem({ 0x88 }, regPSW, RDX, offsetof(registers_t, psw));
+	x.mem({ 0x88 }, regSP, RDX, offsetof(registers_t, sp));
+	x.code.push_back(0x66);				//operand size prefix
+	x.mem({ 0x89 }, regDPTR, RDX, offsetof(registers_t, dptr));
+	x.mem({ 0x89 }, regBudget, regContext, offsetof(jitContext_t, budget), true);
+	x.bytes({ 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0xC3 });	//pop r14, r13, r12; ret
+
+	block->bank = bank;
+	block->native = jitMemory.commit(x.code.data(), x.code.size());
+	return block->native != nullptr;
+#else
+	(void)block;
+	return false;
+#endif
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+
+typedef unsigned char uchar;
+typedef unsigned short ushort;
+
+//The JIT is only available for x86-64 hosts. CPU_ENABLE_JIT can be defined
+//to 0 to build without it.
+#if !defined(CPU_ENABLE_JIT)
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_ENABLE_JIT 1
+#else
+#define CPU_ENABLE_JIT 0
+#endif
+#endif
+
+#define JIT_CODE_SIZE (256 * 1024)
+#define JIT_THRESHOLD 16
+
+//State handed to translated code. A, PSW, SP and DPTR are loaded from
+//and stored back to the cpu's register block around every call.
+struct jitContext_t {
+	uchar* ram;
+	uchar* xram;
+	void* registers;		//cpu::registers_t
+	unsigned long long budget;	//instructions left, updated on return
+};
+
+//Translated regions return the 8051 pc to continue from
+typedef ushort jitFunction_t(jitContext_t* context);
+
+//Bump allocator over a block of memory that is writable while code is
+//being copied in and executable otherwise.
+class executableMemory
+{
+public:
+	executableMemory() = default;
+	executableMemory(const executableMemory&) = delete;
+	executableMemory& operator=(const executableMemory&) = delete;
+	executableMemory(executableMemory&& other) noexcept;
+	executableMemory& operator=(executableMemory&& other) noexcept;
+	~executableMemory();
+
+	jitFunction_t* commit(const uchar* code, size_t size);
+	void reset();
+
+private:
+	void release();
+
+	uchar* memory = nullptr;
+	size_t used = 0;
+};
@@ -1,10 +1,163 @@
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <atomic>
 #include "cpu.h"
 
-int main() {
-	cpu::getInstance()->initialize("D:\\Programming\\8051\\Hello\\Objects\\hello.hex");
+#define BENCH_INSTRUCTIONS 200000000UL
+
+struct engineEntry_t {
+	cpu::engine_t engine;
+	const char* name;
+};
+
+static const engineEntry_t engines[] = {
+	{ cpu::engine_t::table, "table" },
+	{ cpu::engine_t::threaded, "threaded" },
+	{ cpu::engine_t::predecoded, "predecoded" },
+	{ cpu::engine_t::block, "block" },
+	{ cpu::engine_t::jit, "jit" },
+	{ cpu::engine_t::recompiled, "recompiled" },
+};
+
+void dumpPort1Callback(void* client) {
+	((cpu*)client)->dumpPort1();
+}
+
+//Copies the firmware's serial output to out from its own thread so the
+//emulation never waits on the console, a file or a pipe. After done is set
+//the ring is emptied once more.
+void drainSerial(cpu& core, FILE* out, const std::atomic<bool>& done) {
+	uchar buffer[4096];
 	while (true) {
-		cpu::getInstance()->emulateCycle();
+		bool last = done.load();
+		size_t count;
+		while ((count = core.readSerialOutput(buffer, sizeof(buffer))) != 0) {
+			fwrite(buffer, 1, count, out);
+		}
+		fflush(out);
+		if (last) {
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+//Streams a file, FIFO or stdin into the serial input through a fixed
+//buffer, reading on only as the firmware takes bytes in, so captures of
+//any size never have to fit in memory
+void feedSerial(cpu& core, FILE* in, const std::atomic<bool>& done) {
+	uchar buffer[64 * 1024];
+	size_t count;
+	while (!done.load() && (count = fread(buffer, 1, sizeof(buffer), in)) != 0) {
+		size_t offset = 0;
+		while (!done.load() && offset < count) {
+			offset += core.writeSerialInput(buffer + offset, count - offset);
+			if (offset < count) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+	}
+}
+
+//Runs every engine over the same hex files and reports emulated MIPS
+int benchmark(int count, char* files[]) {
+	for (int i = 0; i < count; ++i) {
+		for (auto& e : engines) {
+			cpu core;
+			core.setEngine(e.engine);
+			if (!core.initialize(files[i], nullptr, nullptr)) {
+				return 1;
+			}
+			auto start = std::chrono::high_resolution_clock::now();
+			core.execute(BENCH_INSTRUCTIONS);
+			auto end = std::chrono::high_resolution_clock::now();
+			std::chrono::duration<double> seconds = end - start;
+			std::cout << files[i] << "\t" << e.name << "\t"
+				<< BENCH_INSTRUCTIONS / seconds.count() / 1e6 << " MIPS" << std::endl;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	//-realtime paces the run to the emulated clock, the rest is as without it
+	bool realTime = argc > 1 && strcmp(argv[1], "-realtime") == 0;
+	if (realTime) {
+		argv[1] = argv[0];
+		++argv;
+		--argc;
+	}
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " [-realtime] <file.hex> [serial output] [serial input]" << std::endl;
+		std::cerr << "       " << argv[0] << " -bench <file.hex>..." << std::endl;
+		std::cerr << "       " << argv[0] << " -recompile <file.hex> <output.cpp>" << std::endl;
+		std::cerr << "       " << argv[0] << " -profile <file.hex> <instructions>" << std::endl;
+		return 1;
+	}
+	if (strcmp(argv[1], "-bench") == 0) {
+		return benchmark(argc - 2, argv + 2);
+	}
+	if (strcmp(argv[1], "-recompile") == 0 && argc == 4) {
+		cpu core;
+		if (!core.initialize(argv[2], nullptr, nullptr)) {
+			return 1;
+		}
+		return core.recompile(argv[3]) ? 0 : 1;
+	}
+	if (strcmp(argv[1], "-profile") == 0 && argc == 4) {
+		cpu core;
+		if (!core.initialize(argv[2], nullptr, nullptr)) {
+			return 1;
+		}
+		core.setProfiling(true);
+		core.execute(strtoul(argv[3], nullptr, 0));
+		core.reportProfile(std::cout);
+		return 0;
+	}
+
+	FILE* serialOut = stdout;
+	if (argc > 2 && strcmp(argv[2], "-") != 0) {
+		serialOut = fopen(argv[2], "wb");
+		if (serialOut == nullptr) {
+			std::cerr << "Failed to open file " << argv[2] << std::endl;
+			return 1;
+		}
+	}
+
+	FILE* serialIn = nullptr;
+	if (argc > 3) {
+		serialIn = strcmp(argv[3], "-") == 0 ? stdin : fopen(argv[3], "rb");
+		if (serialIn == nullptr) {
+			std::cerr << "Failed to open file " << argv[3] << std::endl;
+			return 1;
+		}
+	}
+
+	cpu core;
+	if (!core.initialize(argv[1], dumpPort1Callback, &core)) {
+		return 1;
+	}
+	core.setRealTime(realTime);
+	std::atomic<bool> done(false);
+	std::thread drain(drainSerial, std::ref(core), serialOut, std::cref(done));
+	std::thread feed;
+	if (serialIn != nullptr) {
+		feed = std::thread(feedSerial, std::ref(core), serialIn, std::cref(done));
+	}
+	core.emulateCycle();
+	done = true;
+	drain.join();
+	if (feed.joinable()) {
+		feed.join();
+	}
+	if (serialOut != stdout) {
+		fclose(serialOut);
+	}
+	if (serialIn != nullptr && serialIn != stdin) {
+		fclose(serialIn);
 	}
 	return 0;
 }
@@ -0,0 +1,243 @@
+#include "cpu.h"
+#include <cstdio>
+#include <cstring>
+
+//Entry points every image can be started from: reset and the interrupt vectors
+static const ushort entryPoints[] = { 0x0000, 0x0003, 0x000B, 0x0013, 0x001B, 0x0023 };
+
+//Static control flow of one instruction. targets receives the addresses pc
+//can be loaded with and the result is their count; fallsThrough is set when
+//execution can continue with the next instruction. A call's return address
+//is reported separately since it is only reached again through RET.
+static int branchTargets(ushort address, const cpu::decoded_t& instruction,
+	ushort targets[2], bool& fallsThrough, ushort& returnAddress)
+{
+	ushort next = address + instruction.length;
+	uchar opcode = instruction.opcode;
+	fallsThrough = false;
+	returnAddress = 0;
+
+	switch (opcode & 0x1F) {
+	case 0x11:	//ACALL
+		returnAddress = next;
+		//fall through
+	case 0x01:	//AJMP
+		targets[0] = (next & 0xF800) | ((opcode >> 5) << 8) | instruction.op1;
+		return 1;
+	}
+
+	switch (opcode) {
+	case 0x12:	//LCALL
+		returnAddress = next;
+		//fall through
+	case 0x02:	//LJMP
+		targets[0] = (instruction.op1 << 8) | instruction.op2;
+		return 1;
+	case 0x22: case 0x32: case 0x73:	//RET, RETI, JMP @A+DPTR
+		return 0;
+	case 0x80:	//SJMP
+		targets[0] = next + (schar)instruction.op1;
+		return 1;
+	case 0x40: case 0x50: case 0x60: case 0x70:	//JC, JNC, JZ, JNZ
+	case 0xD8: case 0xD9: case 0xDA: case 0xDB:	//DJNZ Rn
+	case 0xDC: case 0xDD: case 0xDE: case 0xDF:
+		fallsThrough = true;
+		targets[0] = next + (schar)instruction.op1;
+		return 1;
+	case 0x10: case 0x20: case 0x30:		//JBC, JB, JNB
+	case 0xB4: case 0xB5: case 0xB6: case 0xB7:	//CJNE
+	case 0xB8: case 0xB9: case 0xBA: case 0xBB:
+	case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+	case 0xD5:					//DJNZ direct
+		fallsThrough = true;
+		targets[0] = next + (schar)instruction.op2;
+		return 1;
+	}
+
+	fallsThrough = true;
+	return 0;
+}
+
+//Whether an instruction can bring nextEvent forward in the middle of a
+//block: SFR accesses reach the timers, the interrupt controller and the
+//hooks, and RETI can let a pending interrupt in. op1 holds the direct or
+//bit address, and MOV direct,direct has the destination in op2.
+static bool mayRaiseEvent(const cpu::decoded_t& instruction)
+{
+	const char* mnemonic = cpu::isa[instruction.opcode].mnemonic;
+	if (instruction.opcode == 0x32) {
+		return true;
+	}
+	if (instruction.opcode == 0x85 && instruction.op2 >= 0x80) {
+		return true;
+	}
+	return (strstr(mnemonic, "direct") != nullptr || strstr(mnemonic, "bit") != nullptr) &&
+		instruction.op1 >= 0x80;
+}
+
+//Writes a C++ translation unit for the loaded image. Control flow is
+//recovered from the entry points, every basic block becomes a run of
+//handler calls with constant operands, and static exits jump straight to
+//the next block. Only the loaded part of code memory is walked. pc values
+//the recovery could not see, such as the targets of JMP @A+DPTR, are
+//single-stepped by the interpreter until they reach a known block again.
+bool cpu::recompile(const std::string& fileName)
+{
+	//the generated code has no notion of which bank it is running from
+	if (codeBanks > 1) {
+		std::cerr << "Banked images cannot be recompiled" << std::endl;
+		return false;
+	}
+
+	std::vector<bool> leader(ROM_SIZE, false);
+	std::vector<bool> visited(ROM_SIZE, false);
+	std::vector<ushort> pending;
+	for (auto entry : entryPoints) {
+		//vectors left erased are not followed, they would only decode filler
+		if (entry == 0x0000 || (entry < codeEnd && rom[entry] != 0x00 && rom[entry] != 0xFF)) {
+			leader[entry] = true;
+			pending.push_back(entry);
+		}
+	}
+
+	while (!pending.empty()) {
+		ushort address = pending.back();
+		pending.pop_back();
+		while (address < codeEnd && !visited[address]) {
+			visited[address] = true;
+			auto& instruction = image->decoded[address];
+			ushort targets[2];
+			bool fallsThrough;
+			ushort returnAddress;
+			int count = branchTargets(address, instruction, targets, fallsThrough, returnAddress);
+			for (int i = 0; i < count; ++i) {
+				if (targets[i] < codeEnd) {
+					leader[targets[i]] = true;
+					pending.push_back(targets[i]);
+				}
+			}
+			if (returnAddress != 0 && returnAddress < codeEnd) {
+				leader[returnAddress] = true;
+				pending.push_back(returnAddress);
+			}
+			address += instruction.length;
+			if (isBranch(instruction.opcode)) {
+				if (fallsThrough && address < codeEnd) {
+					leader[address] = true;
+					pending.push_back(address);
+				}
+				break;
+			}
+		}
+		//a fall-through into code that was already walked starts a block there
+		if (address < codeEnd && visited[address]) {
+			leader[address] = true;
+		}
+	}
+
+	//split the walked code into blocks that run up to their first branch or
+	//the next block's start, and note which blocks are jumped to directly
+	struct recompiledBlock_t {
+		ushort start;
+		std::vector<ushort> addresses;
+		std::vector<ushort> exits;
+		bool conditional;
+		int cycles;
+	};
+	std::vector<recompiledBlock_t> recompiled;
+	std::vector<bool> referenced(ROM_SIZE, false);
+	for (unsigned int start = 0; start < codeEnd; ++start) {
+		if (!leader[start] || !visited[start]) {
+			continue;
+		}
+
+		recompiledBlock_t block = { (ushort)start, {}, {}, false, 0 };
+		unsigned int address = start;
+		do {
+			block.addresses.push_back(address);
+			block.cycles += image->decoded[address].cycles;
+			address += image->decoded[address].length;
+		} while (!isBranch(image->decoded[block.addresses.back()].opcode) &&
+			address < codeEnd && !leader[address]);
+
+		auto& last = image->decoded[block.addresses.back()];
+		ushort targets[2];
+		bool fallsThrough;
+		ushort returnAddress;
+		int count = branchTargets(block.addresses.back(), last, targets, fallsThrough, returnAddress);
+		if (fallsThrough) {
+			targets[count++] = address;
+		}
+		block.conditional = count != 1 || (isBranch(last.opcode) && fallsThrough);
+		for (int i = 0; i < count; ++i) {
+			if (targets[i] < codeEnd) {
+				block.exits.push_back(targets[i]);
+				referenced[targets[i]] = true;
+			}
+		}
+		recompiled.push_back(std::move(block));
+	}
+
+	FILE* fp = fopen(fileName.c_str(), "w");
+	if (fp == nullptr) {
+		std::cerr << "Failed to open file " << fileName << std::endl;
+		return false;
+	}
+
+	fprintf(fp, "//Generated by cpu::recompile(). Build it into the emulator by compiling\n");
+	fprintf(fp, "//cpu.cpp with -DCPU_RECOMPILED='\"%s\"' and select engine_t::recompiled.\n\n", fileName.c_str());
+	fprintf(fp, "void cpu::executeRecompiled(unsigned long instructions)\n{\n");
+	fprintf(fp, "\tif (imageChecksum() != 0x%08Xu) {\n", imageChecksum());
+	fprintf(fp, "\t\texecutePredecoded(instructions);\n\t\treturn;\n\t}\n");
+	fprintf(fp, "\t//an event due since the last run waits for the first instruction\n");
+	fprintf(fp, "\tif (instructions > 0 && cycles >= nextEvent) {\n");
+	fprintf(fp, "\t\texecutePredecoded(1);\n\t\t--instructions;\n\t}\n\n");
+	fprintf(fp, "dispatch:\n\tswitch (hot.pc) {\n");
+
+	for (auto& block : recompiled) {
+		fprintf(fp, "\tcase 0x%04X:\n", block.start);
+		if (referenced[block.start]) {
+			fprintf(fp, "\tblock_%04X:\n", block.start);
+		}
+		fprintf(fp, "\t\tif (instructions < %d) goto interpret;\n", (int)block.addresses.size());
+		if (block.addresses.size() == 1 && image->decoded[block.start].idle) {
+			auto& instruction = image->decoded[block.start];
+			fprintf(fp, "\t\tif (staysIdle(0x%02X, 0x%02X)) instructions -= fastForward(instructions - 1, %d);\n",
+				instruction.opcode, instruction.op1, block.cycles);
+		}
+		else if (block.addresses.size() == 1 && image->decoded[block.start].delay) {
+			fprintf(fp, "\t\tinstructions -= skipDelay(instructions - 1);\n");
+		}
+		fprintf(fp, "\t\tif (cycles + %d >= nextEvent) goto single;\n", block.cycles);
+		fprintf(fp, "\t\tinstructions -= %d;\n", (int)block.addresses.size());
+		for (size_t i = 0; i < block.addresses.size(); ++i) {
+			auto& instruction = image->decoded[block.addresses[i]];
+			fprintf(fp, "\t\thot.pc = 0x%04X; cycles += %d; exec<0x%02X>(0x%02X, 0x%02X);\t//%s\n",
+				(block.addresses[i] + instruction.length) & 0xFFFF, instruction.cycles, instruction.opcode,
+				instruction.op1, instruction.op2, isa[instruction.opcode].mnemonic);
+			size_t remaining = block.addresses.size() - i - 1;
+			if (remaining != 0 && mayRaiseEvent(instruction)) {
+				fprintf(fp, "\t\tif (cycles >= nextEvent) { instructions += %d; goto single; }\n", (int)remaining);
+			}
+		}
+		if (!block.conditional && block.exits.size() == 1) {
+			fprintf(fp, "\t\tgoto block_%04X;\n", block.exits[0]);
+			continue;
+		}
+		for (auto exit : block.exits) {
+			fprintf(fp, "\t\tif (hot.pc == 0x%04X) goto block_%04X;\n", exit, exit);
+		}
+		fprintf(fp, "\t\tgoto dispatch;\n");
+	}
+
+	fprintf(fp, "\t}\n\n");
+	fprintf(fp, "\t//pc is outside the recovered code, or an event falls due within the\n");
+	fprintf(fp, "\t//block, so step up to it or run it\n");
+	fprintf(fp, "single:\n");
+	fprintf(fp, "\tif (cycles >= nextEvent) {\n\t\trunEvents();\n\t\tgoto dispatch;\n\t}\n");
+	fprintf(fp, "\tif (instructions == 0) {\n\t\treturn;\n\t}\n");
+	fprintf(fp, "\texecutePredecoded(1);\n\t--instructions;\n\tgoto dispatch;\n\n");
+	fprintf(fp, "interpret:\n\texecutePredecoded(instructions);\n}\n");
+	fclose(fp);
+	return true;
+}
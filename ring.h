@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+typedef unsigned char uchar;
+
+//Single producer, single consumer byte queue: push() is only called from
+//one thread and pop() from one other, and neither side locks or waits.
+//The indices only grow and are masked on access, so SIZE must be a power
+//of two. Each side keeps its index and a cached copy of the other side's
+//on its own cache line and only reloads the other index when the cached
+//one says the ring is full or empty.
+template<size_t SIZE>
+class ring_t
+{
+	static_assert((SIZE & (SIZE - 1)) == 0, "ring size must be a power of two");
+
+public:
+	//Returns false, dropping value, when the consumer has fallen SIZE bytes behind
+	bool push(uchar value) {
+		size_t tail = writeIndex.load(std::memory_order_relaxed);
+		if (tail - readCached == SIZE) {
+			readCached = readIndex.load(std::memory_order_acquire);
+			if (tail - readCached == SIZE) {
+				return false;
+			}
+		}
+		buffer[tail & (SIZE - 1)] = value;
+		writeIndex.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Adds as many of the size bytes at in as fit and returns how many did
+	size_t push(const uchar* in, size_t size) {
+		size_t tail = writeIndex.load(std::memory_order_relaxed);
+		if (SIZE - (tail - readCached) < size) {
+			readCached = readIndex.load(std::memory_order_acquire);
+		}
+		size_t count = SIZE - (tail - readCached);
+		if (count > size) {
+			count = size;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			buffer[(tail + i) & (SIZE - 1)] = in[i];
+		}
+		writeIndex.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	//Returns false when the ring is empty
+	bool pop(uchar& value) {
+		size_t head = readIndex.load(std::memory_order_relaxed);
+		if (writeCached == head) {
+			writeCached = writeIndex.load(std::memory_order_acquire);
+			if (writeCached == head) {
+				return false;
+			}
+		}
+		value = buffer[head & (SIZE - 1)];
+		readIndex.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Consumer side: whether pop() would find nothing
+	bool empty() {
+		size_t head = readIndex.load(std::memory_order_relaxed);
+		if (writeCached == head) {
+			writeCached = writeIndex.load(std::memory_order_acquire);
+		}
+		return writeCached == head;
+	}
+
+	//Copies up to size bytes to out and returns how many there were
+	size_t pop(uchar* out, size_t size) {
+		size_t head = readIndex.load(std::memory_order_relaxed);
+		if (writeCached == head) {
+			writeCached = writeIndex.load(std::memory_order_acquire);
+		}
+		size_t count = writeCached - head;
+		if (count > size) {
+			count = size;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			out[i] = buffer[(head + i) & (SIZE - 1)];
+		}
+		readIndex.store(head + count, std::memory_order_release);
+		return count;
+	}
+
+private:
+	alignas(64) std::atomic<size_t> writeIndex{ 0 };
+	size_t readCached = 0;		//producer's view of readIndex
+	alignas(64) std::atomic<size_t> readIndex{ 0 };
+	size_t writeCached = 0;		//consumer's view of writeIndex
+	alignas(64) uchar buffer[SIZE];
+};
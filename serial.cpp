@@ -0,0 +1,93 @@
+#include "cpu.h"
+
+//Bits per frame by mode: the shift register's eight, start + 8 + stop, and
+//start + 9 + stop
+static const unsigned int frameBits[4] = { 8, 10, 11, 11 };
+
+//Mode 0 shifts a bit every 12 oscillator periods and mode 2 every 64, or 32
+//with SMOD. Modes 1 and 3 take 32 overflows of timer 1 per bit, 16 with
+//SMOD. Timer 1 is taken to run as the baud generator in whatever mode TMOD
+//gives it: mode 2 overflows every 256 - TH1 cycles, the others count their
+//full range since their reload is up to the firmware.
+unsigned long long cpu::frameCycles()
+{
+	uchar mode = sfr[scon - sfr_base] >> 6;
+	bool smod = (sfr[pcon - sfr_base] & pcon_smod) != 0;
+	unsigned long long clocksPerBit;
+	switch (mode) {
+	case 0:
+		clocksPerBit = 12;
+		break;
+	case 2:
+		clocksPerBit = smod ? 32 : 64;
+		break;
+	default: {
+		unsigned long long overflow;
+		switch ((sfr[tmod - sfr_base] >> 4) & 0x03) {
+		case 0:
+			overflow = 0x2000;
+			break;
+		case 2:
+			overflow = 0x100 - sfr[th1 - sfr_base];
+			break;
+		default:
+			overflow = 0x10000;
+			break;
+		}
+		clocksPerBit = (smod ? 16 : 32) * overflow * clocksPerMachineCycle;
+		break;
+	}
+	}
+	unsigned long long clocks = frameBits[mode] * clocksPerBit;
+	return (clocks + clocksPerMachineCycle - 1) / clocksPerMachineCycle;
+}
+
+//A write to SBUF while a byte is still shifting out replaces it, as the
+//hardware would garble it
+void cpu::startTransmit(uchar value)
+{
+	transmitting = value;
+	scheduleEvent(transmitEvent, cycles + frameCycles());
+}
+
+//The ninth bit of modes 2 and 3 is not passed on
+void cpu::transmitDone()
+{
+	if (!serialOutput->push(transmitting)) {
+		++serialDropped;
+	}
+	sfr[scon - sfr_base] |= scon_ti;
+	updateInterrupts();
+}
+
+//Frames are received back to back while REN is set, RI is clear and the
+//host has bytes waiting. When the firmware is not ready the line is held
+//instead of overrunning SBUF, and the next frame starts once it clears RI
+//or sets REN. An idle line has no event pending, so it does not cut idle
+//loops short; execute() looks for new bytes as it starts a run.
+void cpu::scheduleReceive()
+{
+	uchar control = sfr[scon - sfr_base];
+	if (!(control & scon_ren) || (control & scon_ri) || serialInput->empty()) {
+		cancelEvent(receiveEvent);
+	}
+	else if (!isScheduled(receiveEvent)) {
+		scheduleEvent(receiveEvent, cycles + frameCycles());
+	}
+}
+
+//The stop bit of mode 1 and the ninth bit of modes 2 and 3 are received as 1
+void cpu::receiveDone()
+{
+	uchar value;
+	if (serialInput->pop(value)) {
+		uchar& control = sfr[scon - sfr_base];
+		sfr[sbuf - sfr_base] = value;
+		control |= scon_ri;
+		if ((control >> 6) != 0) {
+			control |= scon_rb8;
+		}
+		updateInterrupts();
+	}
+	scheduleReceive();
+}
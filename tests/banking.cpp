@@ -0,0 +1,113 @@
+//Banked code: common code below 8000h switching banks to read tables and
+//call routines at the same address in each, a bank switch taking effect on
+//the next instruction, a failed reload leaving the core as it was, and a
+//second core running from the first one's image.
+#include "tests.h"
+#include <cstdio>
+#include <memory>
+
+static const program_t banked = { "common", 0xB1, {
+	{ 0x00000, {
+		0x75, 0x81, 0x5F,	//MOV SP,#5Fh
+		0x90, 0x80, 0x00,	//MOV DPTR,#8000h
+		0x75, 0xB1, 0x01,	//MOV 0B1h,#1
+		0xE4,				//CLR A
+		0x93,				//MOVC A,@A+DPTR
+		0xFA,				//MOV R2,A
+		0x75, 0xB1, 0x02,	//MOV 0B1h,#2
+		0xE4,				//CLR A
+		0x93,				//MOVC A,@A+DPTR
+		0xFB,				//MOV R3,A
+		0x12, 0x80, 0x10,	//LCALL 8010h
+		0x80, 0xFE,			//SJMP $
+	} },
+	{ 0x18000, {
+		0x11,				//DB 11h
+	} },
+	{ 0x18010, {
+		0x0F,				//INC R7
+		0x0F,				//INC R7
+		0x0F,				//INC R7
+		0x7E, 0x01,			//MOV R6,#1
+		0x22,				//RET
+	} },
+	{ 0x28000, {
+		0x22,				//DB 22h
+	} },
+	{ 0x28010, {
+		0x7D, 0x02,			//MOV R5,#2
+		0x75, 0xB1, 0x01,	//MOV 0B1h,#1
+		0x0E,				//INC R6
+		0x22,				//RET
+	} },
+} };
+
+//Valid up to code for bank 8, past the banks the select mask reaches
+static const char* badFile = "test_bad.hex";
+static const char* badRecords =
+	":020000040001F9\n"
+	":0280000080FE00\n"
+	":020000040008F2\n"
+	":01800000007F\n"
+	":00000001FF\n";
+
+static bool test(const config_t& config)
+{
+	bool passed = true;
+	auto core = std::make_unique<cpu>();
+	if (!load(*core, banked, config)) {
+		return false;
+	}
+
+	//the routine in bank 2 selects bank 1 and returns through bank 1's RET
+	core->execute(13);
+	passed &= check("banking", config, "PC after the switch in bank 2", 0x8015, core->getPC());
+	passed &= check("banking", config, "cycles after the switch in bank 2", 21, core->getCycles());
+	passed &= check("banking", config, "bank after the switch in bank 2", 1, core->getCodeBank());
+	core->execute(7);
+	std::string state = "PC=0015 A=22 B=00 PSW=00 SP=5F DPTR=8000 P=FF FF FF FF R=00 00 11 22 00 02 00 00 "
+		"TCON=00 T0=0000 T1=0000 IE=00 IP=00 cycles=35";
+	passed &= check("banking", config, "state after the call", state, describe(*core));
+	passed &= check("banking", config, "bank after the call", 1, core->getCodeBank());
+
+	FILE* fp = fopen(badFile, "w");
+	if (fp == nullptr) {
+		std::cerr << "Failed to open file " << badFile << std::endl;
+		return false;
+	}
+	fputs(badRecords, fp);
+	fclose(fp);
+	auto image = core->getImage();
+	bool reloaded = core->initialize(badFile, nullptr, nullptr);
+	remove(badFile);
+	passed &= check("banking", config, "reload from a bad file", 0, reloaded);
+	passed &= check("banking", config, "image after a failed reload", 1, core->getImage() == image);
+	passed &= check("banking", config, "state after a failed reload", state, describe(*core));
+	passed &= check("banking", config, "bank after a failed reload", 1, core->getCodeBank());
+	core->execute(2);
+	passed &= check("banking", config, "cycles running on after a failed reload", 39, core->getCycles());
+	passed &= check("banking", config, "PC running on after a failed reload", 0x0015, core->getPC());
+
+	auto shared = std::make_unique<cpu>();
+	shared->setEngine(config.engine);
+	shared->setFusion(config.fusion);
+	shared->setCodeBanking(banked.bankSelect, 0x07);
+	if (!shared->initialize(image, nullptr, nullptr)) {
+		std::cerr << "Failed to share the image" << std::endl;
+		return false;
+	}
+	shared->setProfiling(config.profiling);
+	shared->execute(20);
+	passed &= check("banking", config, "state of a core sharing the image", state, describe(*shared));
+	passed &= check("banking", config, "image of a core sharing the image", 1, shared->getImage() == image);
+	return passed;
+}
+
+bool testBanking()
+{
+	bool passed = true;
+	for (auto& config : configs) {
+		passed &= test(config);
+	}
+	return passed;
+}
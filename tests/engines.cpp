@@ -0,0 +1,276 @@
+//Engine equivalence: every engine runs the images below and has to end in
+//the state worked out by hand at a few points and, at every budget, in the
+//same state as the table engine
+#include "tests.h"
+#include <memory>
+
+static const program_t programs[] = {
+	//Fused sequences (CLR C; MOV A,Rn; SUBB, MOV A,Rn; ADD, MOVX; INC DPTR,
+	//CLR A; MOVC) with the lazy flags read back through PSW after ADD, SUBB
+	//and DA, pushed, and tested by JNC, MOV C,OV and ADDC
+	{ "alu", 0, {
+		{ 0x0000, {
+			0x75, 0x81, 0x40,	//MOV SP,#40h
+			0x90, 0x01, 0x00,	//MOV DPTR,#0100h
+			0x78, 0x00,			//MOV R0,#0
+			0x7D, 0x00,			//MOV R5,#0
+			0x7E, 0x37,			//MOV R6,#37h
+			0xC3,				//loop: CLR C
+			0xEE,				//MOV A,R6
+			0x94, 0x25,			//SUBB A,#25h
+			0x50, 0x01,			//JNC s1
+			0x0D,				//INC R5
+			0xAA, 0xD0,			//s1: MOV R2,PSW
+			0xE8,				//MOV A,R0
+			0x24, 0x99,			//ADD A,#99h
+			0xAB, 0xD0,			//MOV R3,PSW
+			0xD4,				//DA A
+			0xAC, 0xD0,			//MOV R4,PSW
+			0xC0, 0xD0,			//PUSH PSW
+			0x3E,				//ADDC A,R6
+			0x50, 0x01,			//JNC skip
+			0x0D,				//INC R5
+			0xF0,				//skip: MOVX @DPTR,A
+			0xA3,				//INC DPTR
+			0xC3,				//CLR C
+			0x9D,				//SUBB A,R5
+			0x33,				//RLC A
+			0xF5, 0xF0,			//MOV B,A
+			0xD0, 0xE0,			//POP ACC
+			0x6A,				//XRL A,R2
+			0x6B,				//XRL A,R3
+			0x6C,				//XRL A,R4
+			0x65, 0xF0,			//XRL A,B
+			0xFF,				//MOV R7,A
+			0xE4,				//CLR A
+			0x93,				//MOVC A,@A+DPTR
+			0x2F,				//ADD A,R7
+			0xFE,				//MOV R6,A
+			0xA2, 0xD2,			//MOV C,OV
+			0x92, 0xD5,			//MOV F0,C
+			0xE5, 0xD0,			//MOV A,PSW
+			0x54, 0xFE,			//ANL A,#0FEh
+			0x3E,				//ADDC A,R6
+			0xF9,				//MOV R1,A
+			0x08,				//INC R0
+			0xB8, 0x00, 0xC8,	//CJNE R0,#0,loop
+			0x80, 0xFE,			//SJMP $
+		} },
+	} },
+	//JNB TF0,$ polling a timer, then JZ $, JC $ and SJMP $ idling while a
+	//low priority timer 0 handler and a high priority timer 1 handler run
+	{ "poll", 0, {
+		{ 0x0000, {
+			0x02, 0x00, 0x30,	//LJMP main
+		} },
+		{ 0x000B, {
+			0x02, 0x00, 0x68,	//LJMP t0
+		} },
+		{ 0x001B, {
+			0x02, 0x00, 0x76,	//LJMP t1
+		} },
+		{ 0x0030, {
+			0x75, 0x81, 0x60,	//main: MOV SP,#60h
+			0x75, 0x89, 0x21,	//MOV TMOD,#21h
+			0x75, 0x8D, 0xF0,	//MOV TH1,#0F0h
+			0x75, 0x8B, 0xF0,	//MOV TL1,#0F0h
+			0xD2, 0x8E,			//SETB TR1
+			0x7F, 0x06,			//MOV R7,#6
+			0x75, 0x8C, 0xFC,	//p1: MOV TH0,#0FCh
+			0x75, 0x8A, 0x18,	//MOV TL0,#18h
+			0xC2, 0x8D,			//CLR TF0
+			0xD2, 0x8C,			//SETB TR0
+			0x30, 0x8D, 0xFD,	//JNB TF0,$
+			0xC2, 0x8C,			//CLR TR0
+			0x05, 0x90,			//INC P1
+			0xDF, 0xED,			//DJNZ R7,p1
+			0x75, 0x8C, 0xF8,	//MOV TH0,#0F8h
+			0x75, 0x8A, 0x00,	//MOV TL0,#0
+			0xD2, 0x8C,			//SETB TR0
+			0x75, 0xA8, 0x8A,	//MOV IE,#8Ah
+			0xD2, 0xBB,			//SETB PT1
+			0xE4,				//CLR A
+			0x60, 0xFE,			//w1: JZ w1
+			0xD3,				//SETB C
+			0x40, 0xFE,			//w2: JC w2
+			0x80, 0xFE,			//SJMP $
+			0x75, 0x8C, 0xF8,	//t0: MOV TH0,#0F8h
+			0x08,				//INC R0
+			0xB8, 0x08, 0x02,	//CJNE R0,#8,x0
+			0x74, 0x01,			//MOV A,#1
+			0xB8, 0x0C, 0x01,	//x0: CJNE R0,#12,x1
+			0xC3,				//CLR C
+			0x32,				//x1: RETI
+			0x09,				//t1: INC R1
+			0x05, 0xA0,			//INC P2
+			0x32,				//RETI
+		} },
+	} },
+	//Nested DJNZ delays, with and without a reload, and a 256 pass DJNZ,
+	//while a timer 0 handler overwrites the inner counter now and then
+	{ "delay", 0, {
+		{ 0x0000, {
+			0x02, 0x00, 0x30,	//LJMP main
+		} },
+		{ 0x000B, {
+			0x02, 0x00, 0x5B,	//LJMP t0
+		} },
+		{ 0x0030, {
+			0x75, 0x81, 0x60,	//main: MOV SP,#60h
+			0x75, 0x89, 0x01,	//MOV TMOD,#01h
+			0x75, 0x8C, 0xC0,	//MOV TH0,#0C0h
+			0x75, 0x8A, 0x00,	//MOV TL0,#0
+			0xD2, 0x8C,			//SETB TR0
+			0x75, 0xA8, 0x82,	//MOV IE,#82h
+			0x05, 0x90,			//loop: INC P1
+			0x7D, 0x03,			//MOV R5,#3
+			0x7F, 0xC8,			//d3: MOV R7,#0C8h
+			0x7E, 0xFA,			//d2: MOV R6,#0FAh
+			0xDE, 0xFE,			//d1: DJNZ R6,d1
+			0xDF, 0xFA,			//DJNZ R7,d2
+			0xDD, 0xF6,			//DJNZ R5,d3
+			0x7F, 0x05,			//MOV R7,#5
+			0xDE, 0xFE,			//e2: DJNZ R6,e2
+			0xDF, 0xFC,			//DJNZ R7,e2
+			0x7A, 0x00,			//MOV R2,#0
+			0xDA, 0xFE,			//f1: DJNZ R2,f1
+			0x80, 0xE6,			//SJMP loop
+			0x75, 0x8C, 0xC0,	//t0: MOV TH0,#0C0h
+			0x08,				//INC R0
+			0xC0, 0xD0,			//PUSH PSW
+			0x7E, 0x07,			//MOV R6,#7
+			0xD0, 0xD0,			//POP PSW
+			0x32,				//RETI
+		} },
+	} },
+	//Bank switches from banked code in the middle of a block: each bank
+	//selects the other and goes on with different code at the same address
+	{ "banked", 0xB1, {
+		{ 0x00000, {
+			0x75, 0xB1, 0x01,	//MOV 0B1h,#1
+			0x02, 0x80, 0x00,	//LJMP 8000h
+		} },
+		{ 0x18000, {
+			0x75, 0xB1, 0x02,	//MOV 0B1h,#2
+			0x0E,				//INC R6
+			0x0E,				//INC R6
+			0x80, 0xF9,			//SJMP 8000h
+		} },
+		{ 0x28000, {
+			0x75, 0xB1, 0x01,	//MOV 0B1h,#1
+			0x0D,				//INC R5
+			0xDF, 0xFE,			//DJNZ R7,$
+			0x80, 0xF8,			//SJMP 8000h
+		} },
+	} },
+};
+
+//Budgets for one execute() call, from single steps that end inside fused
+//records and blocks to runs across many interrupts and delay loops
+static const unsigned long budgets[] = { 1, 2, 3, 5, 7, 10, 13, 64, 100, 1001, 4097, 65537, 1000003 };
+
+//Budgets cycled through by runs of many execute() calls in a row
+static const unsigned long steps[] = { 1, 3, 2, 17, 250, 5, 4099, 11, 60013 };
+static const int stepRuns = 200;
+
+//States worked out by hand, after a number of instructions from reset
+static const struct {
+	const char* program;
+	unsigned long instructions;
+	const char* state;
+} expectedStates[] = {
+	//up to ADDC A,R6, whose 99h + 37h sets AC and leaves D0h with odd parity
+	{ "alu", 17, "PC=0020 A=D0 B=00 PSW=41 SP=41 DPTR=0100 P=FF FF FF FF R=00 00 00 00 00 00 37 00 "
+		"TCON=00 T0=0000 T1=0000 IE=00 IP=00 cycles=24" },
+	//one pass of the loop, taking neither INC R5
+	{ "alu", 42, "PC=000C A=A0 B=A0 PSW=00 SP=40 DPTR=0101 P=FF FF FF FF R=01 A0 00 00 00 00 A0 A0 "
+		"TCON=00 T0=0000 T1=0000 IE=00 IP=00 cycles=56" },
+	//the first poll of TF0 to see it set, 1000 cycles after SETB TR0, with
+	//timer 1 running and reloading every 16 cycles, and the CLR TR0 cycle
+	//still counted
+	{ "poll", 514, "PC=0040 A=00 B=00 PSW=00 SP=60 DPTR=0000 P=FF 00 FF FF R=00 00 00 00 00 00 00 05 "
+		"TCON=E0 T0=0001 T1=F0F3 IE=00 IP=00 cycles=1022" },
+	//the first pass of the inner delay loop
+	{ "delay", 262, "PC=0047 A=00 B=00 PSW=00 SP=60 DPTR=0000 P=FF 00 FF FF R=00 00 00 00 00 03 00 C7 "
+		"TCON=10 T0=C1FC T1=0000 IE=82 IP=00 cycles=519" },
+	//timer 0 overflows at cycle 16395, in the 141st DJNZ R6 of the 33rd
+	//pass, and the vector is taken right after it
+	{ "delay", 8216, "PC=000B A=00 B=00 PSW=00 SP=62 DPTR=0000 P=FF 00 FF FF R=00 00 00 00 00 03 6D A8 "
+		"TCON=10 T0=0002 T1=0000 IE=82 IP=00 cycles=16397" },
+	//the sixth DJNZ R7,$ of the second visit to bank 2
+	{ "banked", 273, "PC=8004 A=00 B=00 PSW=00 SP=08 DPTR=0000 P=FF FF FF FF R=00 00 00 00 00 02 02 FA "
+		"TCON=00 T0=0000 T1=0000 IE=00 IP=00 cycles=542" },
+};
+
+static bool test(const program_t& program)
+{
+	const config_t& table = configs.front();
+	bool passed = true;
+	for (auto& expected : expectedStates) {
+		if (std::string(expected.program) != program.name) {
+			continue;
+		}
+		for (auto& config : configs) {
+			auto core = std::make_unique<cpu>();
+			if (!load(*core, program, config)) {
+				return false;
+			}
+			core->execute(expected.instructions);
+			passed &= check(program.name, config, std::to_string(expected.instructions) + " instructions",
+				expected.state, describe(*core));
+		}
+	}
+
+	for (auto budget : budgets) {
+		auto reference = std::make_unique<cpu>();
+		if (!load(*reference, program, table)) {
+			return false;
+		}
+		reference->execute(budget);
+		std::string expected = describe(*reference);
+		for (auto& config : configs) {
+			if (&config == &table) {
+				continue;
+			}
+			auto core = std::make_unique<cpu>();
+			if (!load(*core, program, config)) {
+				return false;
+			}
+			core->execute(budget);
+			passed &= check(program.name, config, std::to_string(budget) + " instructions",
+				expected, describe(*core));
+		}
+	}
+
+	//state carried from one execute() call to the next
+	for (auto& config : configs) {
+		if (&config == &table) {
+			continue;
+		}
+		auto reference = std::make_unique<cpu>();
+		auto core = std::make_unique<cpu>();
+		if (!load(*reference, program, table) || !load(*core, program, config)) {
+			return false;
+		}
+		for (int run = 0; run < stepRuns; ++run) {
+			unsigned long budget = steps[run % (sizeof(steps) / sizeof(steps[0]))];
+			reference->execute(budget);
+			core->execute(budget);
+			if (!check(program.name, config, "call " + std::to_string(run) + " of " + std::to_string(budget),
+				describe(*reference), describe(*core))) {
+				passed = false;
+				break;
+			}
+		}
+	}
+	return passed;
+}
+
+bool testEngines()
+{
+	bool passed = true;
+	for (auto& program : programs) {
+		passed &= test(program);
+	}
+	return passed;
+}
@@ -0,0 +1,108 @@
+//Vectoring on a timer overflow, returning with RETI, and a high priority
+//external interrupt nesting in a low priority handler. A request is taken
+//at the end of the instruction in which it is raised, and the vector takes
+//two cycles.
+#include "tests.h"
+#include <memory>
+
+static const program_t timer = { "timer", 0, {
+	{ 0x0000, {
+		0x02, 0x00, 0x30,	//LJMP main
+	} },
+	{ 0x000B, {
+		0x08,				//t0: INC R0
+		0x32,				//RETI
+	} },
+	{ 0x0030, {
+		0x75, 0x81, 0x5F,	//main: MOV SP,#5Fh
+		0x75, 0x89, 0x01,	//MOV TMOD,#01h
+		0x75, 0x8C, 0xFF,	//MOV TH0,#0FFh
+		0x75, 0x8A, 0xF8,	//MOV TL0,#0F8h
+		0x75, 0xA8, 0x82,	//MOV IE,#82h
+		0xD2, 0x8C,			//SETB TR0
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static const program_t nested = { "nested", 0, {
+	{ 0x0000, {
+		0x02, 0x00, 0x30,	//LJMP main
+	} },
+	{ 0x0003, {
+		0x09,				//x0: INC R1
+		0x32,				//RETI
+	} },
+	{ 0x000B, {
+		0x08,				//t0: INC R0
+		0x80, 0xFE,			//SJMP $
+	} },
+	{ 0x0030, {
+		0x75, 0x81, 0x5F,	//main: MOV SP,#5Fh
+		0x75, 0x89, 0x01,	//MOV TMOD,#01h
+		0x75, 0x8C, 0xFF,	//MOV TH0,#0FFh
+		0x75, 0x8A, 0xFC,	//MOV TL0,#0FCh
+		0xD2, 0x88,			//SETB IT0
+		0x75, 0xB8, 0x01,	//MOV IP,#01h
+		0x75, 0xA8, 0x83,	//MOV IE,#83h
+		0xD2, 0x8C,			//SETB TR0
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static bool test(const config_t& config)
+{
+	bool passed = true;
+
+	//timer 0 overflows at cycle 21, at the end of the fourth SJMP $
+	auto core = std::make_unique<cpu>();
+	if (!load(*core, timer, config)) {
+		return false;
+	}
+	core->execute(11);
+	passed &= check("timer", config, "PC at the vector", 0x000B, core->getPC());
+	passed &= check("timer", config, "cycles at the vector", 23, core->getCycles());
+	passed &= check("timer", config, "SP at the vector", 0x61, core->getSP());
+	passed &= check("timer", config, "TCON at the vector", 0x10, core->getTCON());
+	core->execute(2);
+	passed &= check("timer", config, "R0 after RETI", 1, core->getR0());
+	passed &= check("timer", config, "PC after RETI", 0x0041, core->getPC());
+	passed &= check("timer", config, "cycles after RETI", 26, core->getCycles());
+	passed &= check("timer", config, "SP after RETI", 0x5F, core->getSP());
+	passed &= check("timer", config, "T0 after RETI", 0x0005, (core->getTH0() << 8) | core->getTL0());
+
+	//timer 0 overflows at cycle 20 and its handler spins; a falling edge on
+	//INT0 then preempts it from the end of the next SJMP $
+	core = std::make_unique<cpu>();
+	if (!load(*core, nested, config)) {
+		return false;
+	}
+	core->execute(11);
+	passed &= check("nested", config, "PC at the timer vector", 0x000B, core->getPC());
+	passed &= check("nested", config, "cycles at the timer vector", 22, core->getCycles());
+	passed &= check("nested", config, "SP at the timer vector", 0x61, core->getSP());
+	core->execute(3);
+	passed &= check("nested", config, "R0 in the timer handler", 1, core->getR0());
+	passed &= check("nested", config, "PC in the timer handler", 0x000C, core->getPC());
+	passed &= check("nested", config, "cycles in the timer handler", 27, core->getCycles());
+	core->setInterruptPin(0, false);
+	core->execute(1);
+	passed &= check("nested", config, "PC at the INT0 vector", 0x0003, core->getPC());
+	passed &= check("nested", config, "cycles at the INT0 vector", 31, core->getCycles());
+	passed &= check("nested", config, "SP at the INT0 vector", 0x63, core->getSP());
+	passed &= check("nested", config, "TCON at the INT0 vector", 0x11, core->getTCON());
+	core->execute(2);
+	passed &= check("nested", config, "R1 back in the timer handler", 1, core->getR1());
+	passed &= check("nested", config, "PC back in the timer handler", 0x000C, core->getPC());
+	passed &= check("nested", config, "cycles back in the timer handler", 34, core->getCycles());
+	passed &= check("nested", config, "SP back in the timer handler", 0x61, core->getSP());
+	return passed;
+}
+
+bool testInterrupts()
+{
+	bool passed = true;
+	for (auto& config : configs) {
+		passed &= test(config);
+	}
+	return passed;
+}
@@ -0,0 +1,89 @@
+//Mode 1 frames at the rate timer 1 sets: with TH1 = FDh it overflows every
+//3 cycles and a bit takes 32 overflows, so a 10 bit frame takes 960 cycles.
+//TI and RI are set as the last cycle of a frame ends and are seen by the
+//instructions after it.
+#include "tests.h"
+#include <memory>
+
+static const program_t transmit = { "transmit", 0, {
+	{ 0x0000, {
+		0x75, 0x89, 0x20,	//MOV TMOD,#20h
+		0x75, 0x8D, 0xFD,	//MOV TH1,#0FDh
+		0xD2, 0x8E,			//SETB TR1
+		0x75, 0x98, 0x50,	//MOV SCON,#50h
+		0x75, 0x99, 0x41,	//MOV SBUF,#41h
+		0x30, 0x99, 0xFD,	//JNB TI,$
+		0xC2, 0x99,			//CLR TI
+		0x75, 0x99, 0x42,	//MOV SBUF,#42h
+		0x30, 0x99, 0xFD,	//JNB TI,$
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static const program_t receive = { "receive", 0, {
+	{ 0x0000, {
+		0x75, 0x89, 0x20,	//MOV TMOD,#20h
+		0x75, 0x8D, 0xFD,	//MOV TH1,#0FDh
+		0xD2, 0x8E,			//SETB TR1
+		0x75, 0x98, 0x50,	//MOV SCON,#50h
+		0x30, 0x98, 0xFD,	//JNB RI,$
+		0xE5, 0x99,			//MOV A,SBUF
+		0xC2, 0x98,			//CLR RI
+		0xFF,				//MOV R7,A
+		0x30, 0x98, 0xFD,	//JNB RI,$
+		0xAE, 0x99,			//MOV R6,SBUF
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static bool test(const config_t& config)
+{
+	bool passed = true;
+
+	//'A' is written at cycle 9 and sent at 969, 'B' at 974 and 1934
+	auto core = std::make_unique<cpu>();
+	if (!load(*core, transmit, config)) {
+		return false;
+	}
+	core->execute(480);
+	passed &= check("transmit", config, "cycles while sending A", 959, core->getCycles());
+	passed &= check("transmit", config, "output while sending A", "", serialOutput(*core));
+	core->execute(6);
+	passed &= check("transmit", config, "cycles after sending A", 971, core->getCycles());
+	passed &= check("transmit", config, "PC after sending A", 0x0011, core->getPC());
+	passed &= check("transmit", config, "output after sending A", "A", serialOutput(*core));
+	core->execute(9514);
+	passed &= check("transmit", config, "cycles after sending B", 19998, core->getCycles());
+	passed &= check("transmit", config, "output after sending B", "B", serialOutput(*core));
+
+	//the host's bytes are picked up from cycle 7, the first is in at 967
+	//and the second 960 cycles after CLR RI frees SBUF at 971
+	core = std::make_unique<cpu>();
+	if (!load(*core, receive, config)) {
+		return false;
+	}
+	core->execute(4);
+	const uchar input[] = { 'x', 'y' };
+	core->writeSerialInput(input, sizeof(input));
+	core->execute(480);
+	passed &= check("receive", config, "cycles while receiving x", 967, core->getCycles());
+	passed &= check("receive", config, "PC while receiving x", 0x000B, core->getPC());
+	core->execute(1);
+	passed &= check("receive", config, "cycles after receiving x", 969, core->getCycles());
+	passed &= check("receive", config, "PC after receiving x", 0x000E, core->getPC());
+	core->execute(515);
+	passed &= check("receive", config, "cycles after receiving y", 1996, core->getCycles());
+	passed &= check("receive", config, "A", 'x', core->getACC());
+	passed &= check("receive", config, "R7", 'x', core->getR7());
+	passed &= check("receive", config, "R6", 'y', core->getR6());
+	return passed;
+}
+
+bool testSerial()
+{
+	bool passed = true;
+	for (auto& config : configs) {
+		passed &= test(config);
+	}
+	return passed;
+}
@@ -0,0 +1,142 @@
+//Tests for the emulator core. Each group runs small images on every engine
+//and checks the registers, SFRs and cycle counts they end with, either
+//against values worked out by hand or, for the engines, against the table
+//engine, which executes one instruction at a time with no caching, fusion
+//or fast-forwarding. Build it from the repository root with
+//	g++ -std=c++17 -O2 -I. tests/*.cpp cpu.cpp jit.cpp recompiler.cpp timers.cpp interrupts.cpp serial.cpp -o tests
+//or through tests/Tests.vcxproj, which runs it after every build. Run it
+//from a writable directory, where it writes its images as HEX files. Every
+//mismatch is printed and the exit code is 1 if there was any. The
+//recompiled engine needs code generated per image and is not covered.
+#include "tests.h"
+#include <algorithm>
+#include <cstdio>
+
+const std::vector<config_t> configs = {
+	{ "table", cpu::engine_t::table, false, false },
+	{ "threaded", cpu::engine_t::threaded, false, false },
+	{ "predecoded", cpu::engine_t::predecoded, false, false },
+	{ "fused", cpu::engine_t::predecoded, true, false },
+	{ "block", cpu::engine_t::block, true, false },
+	{ "jit", cpu::engine_t::jit, true, false },
+	{ "profiled", cpu::engine_t::table, false, true },
+};
+
+bool writeHex(const std::string& fileName, const program_t& program)
+{
+	FILE* fp = fopen(fileName.c_str(), "w");
+	if (fp == nullptr) {
+		std::cerr << "Failed to open file " << fileName << std::endl;
+		return false;
+	}
+	for (auto& section : program.sections) {
+		unsigned int bank = (unsigned int)(section.address >> 16);
+		fprintf(fp, ":02000004%04X%02X\n", bank, (0x100 - ((2 + 4 + (bank >> 8) + bank) & 0xFF)) & 0xFF);
+		for (size_t offset = 0; offset < section.bytes.size(); offset += 16) {
+			size_t count = std::min<size_t>(16, section.bytes.size() - offset);
+			unsigned int address = (section.address & 0xFFFF) + (unsigned int)offset;
+			unsigned int sum = (unsigned int)count + (address >> 8) + (address & 0xFF);
+			fprintf(fp, ":%02X%04X00", (unsigned int)count, address);
+			for (size_t i = 0; i < count; ++i) {
+				fprintf(fp, "%02X", section.bytes[offset + i]);
+				sum += section.bytes[offset + i];
+			}
+			fprintf(fp, "%02X\n", (0x100 - (sum & 0xFF)) & 0xFF);
+		}
+	}
+	fprintf(fp, ":00000001FF\n");
+	fclose(fp);
+	return true;
+}
+
+bool load(cpu& core, const program_t& program, const config_t& config)
+{
+	std::string fileName = std::string("test_") + program.name + ".hex";
+	if (!writeHex(fileName, program)) {
+		return false;
+	}
+	core.setEngine(config.engine);
+	core.setFusion(config.fusion);
+	if (program.bankSelect != 0) {
+		core.setCodeBanking(program.bankSelect, 0x07);
+	}
+	bool loaded = core.initialize(fileName, nullptr, nullptr);
+	remove(fileName.c_str());
+	if (!loaded) {
+		std::cerr << "Failed to load " << fileName << std::endl;
+		return false;
+	}
+	core.setProfiling(config.profiling);
+	return true;
+}
+
+std::string describe(cpu& core)
+{
+	char text[256];
+	snprintf(text, sizeof(text), "PC=%04X A=%02X B=%02X PSW=%02X SP=%02X DPTR=%02X%02X "
+		"P=%02X %02X %02X %02X R=%02X %02X %02X %02X %02X %02X %02X %02X "
+		"TCON=%02X T0=%02X%02X T1=%02X%02X IE=%02X IP=%02X cycles=%llu",
+		core.getPC(), core.getACC(), core.getB(), core.getPSW(), core.getSP(), core.getDPH(), core.getDPL(),
+		core.getP0(), core.getP1(), core.getP2(), core.getP3(),
+		core.getR0(), core.getR1(), core.getR2(), core.getR3(),
+		core.getR4(), core.getR5(), core.getR6(), core.getR7(),
+		core.getTCON(), core.getTH0(), core.getTL0(), core.getTH1(), core.getTL1(),
+		core.getIE(), core.getIP(), core.getCycles());
+	return text;
+}
+
+//Drains the bytes transmitted since the last call
+std::string serialOutput(cpu& core)
+{
+	std::string text;
+	uchar buffer[64];
+	size_t count;
+	while ((count = core.readSerialOutput(buffer, sizeof(buffer))) != 0) {
+		text.append((const char*)buffer, count);
+	}
+	return text;
+}
+
+bool check(const std::string& test, const config_t& config, const std::string& what,
+	const std::string& expected, const std::string& actual)
+{
+	if (actual == expected) {
+		return true;
+	}
+	std::cerr << test << ", " << config.name << ", " << what << std::endl;
+	std::cerr << "\texpected " << expected << std::endl;
+	std::cerr << "\tgot      " << actual << std::endl;
+	return false;
+}
+
+bool check(const std::string& test, const config_t& config, const std::string& what,
+	unsigned long long expected, unsigned long long actual)
+{
+	char expectedText[32];
+	char actualText[32];
+	snprintf(expectedText, sizeof(expectedText), "%llX", expected);
+	snprintf(actualText, sizeof(actualText), "%llX", actual);
+	return check(test, config, what, expectedText, actualText);
+}
+
+int main()
+{
+	static const struct {
+		const char* name;
+		bool (*run)();
+	} groups[] = {
+		{ "engines", testEngines },
+		{ "timers", testTimers },
+		{ "interrupts", testInterrupts },
+		{ "serial", testSerial },
+		{ "banking", testBanking },
+	};
+
+	bool passed = true;
+	for (auto& group : groups) {
+		bool groupPassed = group.run();
+		std::cout << group.name << (groupPassed ? " passed" : " FAILED") << std::endl;
+		passed &= groupPassed;
+	}
+	return passed ? 0 : 1;
+}
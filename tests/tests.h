@@ -0,0 +1,45 @@
+#pragma once
+#include "cpu.h"
+#include <string>
+#include <vector>
+
+//Runs of bytes loaded from the given linear addresses, bank * 64K + address
+struct section_t {
+	unsigned long address;
+	std::vector<uchar> bytes;
+};
+
+struct program_t {
+	const char* name;
+	uchar bankSelect;	//SFR selecting the code bank in the bits 0x07, 0 if not banked
+	std::vector<section_t> sections;
+};
+
+//One way of running a core. The table engine comes first and is the
+//reference the engine test compares the others with.
+struct config_t {
+	const char* name;
+	cpu::engine_t engine;
+	bool fusion;
+	bool profiling;
+};
+
+extern const std::vector<config_t> configs;
+
+bool writeHex(const std::string& fileName, const program_t& program);
+//Writes program to a HEX file named after it and loads it as config says
+bool load(cpu& core, const program_t& program, const config_t& config);
+//Everything the public interface shows of a core
+std::string describe(cpu& core);
+std::string serialOutput(cpu& core);
+//Prints a mismatch, named by the test, the config and what was compared
+bool check(const std::string& test, const config_t& config, const std::string& what,
+	const std::string& expected, const std::string& actual);
+bool check(const std::string& test, const config_t& config, const std::string& what,
+	unsigned long long expected, unsigned long long actual);
+
+bool testEngines();
+bool testTimers();
+bool testInterrupts();
+bool testSerial();
+bool testBanking();
@@ -0,0 +1,143 @@
+//Timers 0 and 1 in each mode and gated by INT0, read back between runs.
+//A timer starts counting with the cycle after the one that sets TRx.
+#include "tests.h"
+#include <memory>
+
+static const program_t mode1 = { "mode1", 0, {
+	{ 0x0000, {
+		0x75, 0x89, 0x01,	//MOV TMOD,#01h
+		0x75, 0x8C, 0xFF,	//MOV TH0,#0FFh
+		0x75, 0x8A, 0xF0,	//MOV TL0,#0F0h
+		0xD2, 0x8C,			//SETB TR0
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static const program_t mode2 = { "mode2", 0, {
+	{ 0x0000, {
+		0x75, 0x89, 0x20,	//MOV TMOD,#20h
+		0x75, 0x8D, 0xF0,	//MOV TH1,#0F0h
+		0x75, 0x8B, 0xFA,	//MOV TL1,#0FAh
+		0xD2, 0x8E,			//SETB TR1
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static const program_t mode0 = { "mode0", 0, {
+	{ 0x0000, {
+		0x75, 0x89, 0x00,	//MOV TMOD,#00h
+		0x75, 0x8C, 0xFF,	//MOV TH0,#0FFh
+		0x75, 0x8A, 0x1C,	//MOV TL0,#1Ch
+		0xD2, 0x8C,			//SETB TR0
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static const program_t mode3 = { "mode3", 0, {
+	{ 0x0000, {
+		0x75, 0x89, 0x03,	//MOV TMOD,#03h
+		0x75, 0x8A, 0xFE,	//MOV TL0,#0FEh
+		0x75, 0x8C, 0xFC,	//MOV TH0,#0FCh
+		0xD2, 0x8C,			//SETB TR0
+		0xD2, 0x8E,			//SETB TR1
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static const program_t gate = { "gate", 0, {
+	{ 0x0000, {
+		0x75, 0x89, 0x09,	//MOV TMOD,#09h
+		0xD2, 0x8C,			//SETB TR0
+		0x80, 0xFE,			//SJMP $
+	} },
+} };
+
+static unsigned int timer0(cpu& core)
+{
+	return (core.getTH0() << 8) | core.getTL0();
+}
+
+static unsigned int timer1(cpu& core)
+{
+	return (core.getTH1() << 8) | core.getTL1();
+}
+
+static bool test(const config_t& config)
+{
+	bool passed = true;
+
+	//16 bits from FFF0h, overflowing on the 16th cycle
+	auto core = std::make_unique<cpu>();
+	if (!load(*core, mode1, config)) {
+		return false;
+	}
+	core->execute(4);
+	passed &= check("mode 1", config, "cycles at SETB TR0", 7, core->getCycles());
+	passed &= check("mode 1", config, "T0 at SETB TR0", 0xFFF0, timer0(*core));
+	passed &= check("mode 1", config, "TCON at SETB TR0", 0x10, core->getTCON());
+	core->execute(8);
+	passed &= check("mode 1", config, "cycles after overflow", 23, core->getCycles());
+	passed &= check("mode 1", config, "T0 after overflow", 0x0000, timer0(*core));
+	passed &= check("mode 1", config, "TCON after overflow", 0x30, core->getTCON());
+
+	//TL1 from FAh, overflowing after 6 cycles and counting 14 more from TH1
+	core = std::make_unique<cpu>();
+	if (!load(*core, mode2, config)) {
+		return false;
+	}
+	core->execute(14);
+	passed &= check("mode 2", config, "cycles", 27, core->getCycles());
+	passed &= check("mode 2", config, "T1", 0xF0FE, timer1(*core));
+	passed &= check("mode 2", config, "TCON", 0xC0, core->getTCON());
+
+	//13 bits from 1FFCh, the low five in TL0, overflowing after 4 cycles
+	core = std::make_unique<cpu>();
+	if (!load(*core, mode0, config)) {
+		return false;
+	}
+	core->execute(7);
+	passed &= check("mode 0", config, "cycles", 13, core->getCycles());
+	passed &= check("mode 0", config, "T0", 0x0002, timer0(*core));
+	passed &= check("mode 0", config, "TCON", 0x30, core->getTCON());
+
+	//TL0 on TR0 from cycle 7 and TH0 on TR1 from cycle 8, setting TF0 and
+	//TF1, while timer 1 keeps counting from the TMOD write without a flag
+	core = std::make_unique<cpu>();
+	if (!load(*core, mode3, config)) {
+		return false;
+	}
+	core->execute(7);
+	passed &= check("mode 3", config, "cycles", 12, core->getCycles());
+	passed &= check("mode 3", config, "T0", 0x0003, timer0(*core));
+	passed &= check("mode 3", config, "T1", 0x000A, timer1(*core));
+	passed &= check("mode 3", config, "TCON", 0xF0, core->getTCON());
+
+	//GATE holds timer 0 while INT0 is low, which also sets IE0 with IT0 clear
+	core = std::make_unique<cpu>();
+	if (!load(*core, gate, config)) {
+		return false;
+	}
+	core->execute(9);
+	passed &= check("gate", config, "cycles with INT0 high", 17, core->getCycles());
+	passed &= check("gate", config, "T0 with INT0 high", 0x000E, timer0(*core));
+	core->setInterruptPin(0, false);
+	core->execute(5);
+	passed &= check("gate", config, "cycles with INT0 low", 27, core->getCycles());
+	passed &= check("gate", config, "T0 with INT0 low", 0x000E, timer0(*core));
+	passed &= check("gate", config, "TCON with INT0 low", 0x12, core->getTCON());
+	core->setInterruptPin(0, true);
+	core->execute(5);
+	passed &= check("gate", config, "cycles with INT0 high again", 37, core->getCycles());
+	passed &= check("gate", config, "T0 with INT0 high again", 0x0018, timer0(*core));
+	passed &= check("gate", config, "TCON with INT0 high again", 0x10, core->getTCON());
+	return passed;
+}
+
+bool testTimers()
+{
+	bool passed = true;
+	for (auto& config : configs) {
+		passed &= test(config);
+	}
+	return passed;
+}
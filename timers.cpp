@@ -0,0 +1,179 @@
+#include "cpu.h"
+#include <algorithm>
+
+//TMOD fields of one timer, timer 1 uses the high nibble
+static constexpr uchar tmod_gate = 0x08;
+static constexpr uchar tmod_counter = 0x04;
+static constexpr uchar tmod_mode = 0x03;
+
+//Increments an 8-bit counter that restarts from reload after overflowing:
+//mode 2 reloads from TH, the two halves of mode 3 from 0. Returns whether
+//it overflowed at least once.
+static bool count8(uchar& counter, uchar reload, unsigned long long count)
+{
+	unsigned int toOverflow = 0x100 - counter;
+	if (count < toOverflow) {
+		counter += (uchar)count;
+		return false;
+	}
+	counter = reload + (uchar)((count - toOverflow) % (0x100 - reload));
+	return true;
+}
+
+//Mode 0 counts in TH and the low five bits of TL, mode 1 in all sixteen
+static bool count13or16(uchar mode, uchar& high, uchar& low, unsigned long long count)
+{
+	if (mode == 0) {
+		unsigned long long value = ((high << 5) | (low & 0x1F)) + count;
+		high = (uchar)(value >> 5);
+		low = (low & 0xE0) | (value & 0x1F);
+		return value > 0x1FFF;
+	}
+	unsigned long long value = ((high << 8) | low) + count;
+	high = (uchar)(value >> 8);
+	low = (uchar)value;
+	return value > 0xFFFF;
+}
+
+//Whether a timer counts machine cycles: TRx is set, it is not in counter
+//mode and, with GATE set, its INTx pin is high
+static bool running(uchar control, uchar run, uchar mode, uchar pins, uchar pin)
+{
+	return (control & run) && !(mode & tmod_counter) && (!(mode & tmod_gate) || (pins & pin));
+}
+
+//Increments left until a counter in mode 0, 1 or 2 overflows
+static unsigned long long untilOverflow(uchar mode, uchar high, uchar low)
+{
+	switch (mode) {
+	case 0:
+		return 0x2000 - ((high << 5) | (low & 0x1F));
+	case 1:
+		return 0x10000 - ((high << 8) | low);
+	default:
+		return 0x100 - low;
+	}
+}
+
+//The timers count machine cycles. In counter mode they would count edges
+//on T0/T1, which are not modelled, so they hold their value.
+cpu::timers_t cpu::countTimers(unsigned long long elapsed) const
+{
+	timers_t timers = { sfr[tcon - sfr_base], sfr[th0 - sfr_base], sfr[tl0 - sfr_base],
+		sfr[th1 - sfr_base], sfr[tl1 - sfr_base] };
+	if (elapsed == 0) {
+		return timers;
+	}
+
+	uchar& control = timers.control;
+	uchar modes = sfr[tmod - sfr_base];
+	uchar pins = sfr[p3 - sfr_base];
+	uchar mode0 = modes & 0x0F;
+	uchar mode1 = modes >> 4;
+	bool run0 = running(control, tcon_tr0, mode0, pins, p3_int0);
+	bool run1 = running(control, tcon_tr1, mode1, pins, p3_int1);
+
+	if ((mode0 & tmod_mode) == 3) {
+		//TL0 runs on timer 0's controls, TH0 on TR1 and sets TF1. Timer 1
+		//keeps running outside mode 3, but without a flag of its own.
+		if (run0 && count8(timers.low0, 0, elapsed)) {
+			control |= tcon_tf0;
+		}
+		if ((control & tcon_tr1) && count8(timers.high0, 0, elapsed)) {
+			control |= tcon_tf1;
+		}
+		run1 = !(mode1 & tmod_counter);
+	}
+	else if (run0) {
+		bool overflow = (mode0 & tmod_mode) == 2 ? count8(timers.low0, timers.high0, elapsed) :
+			count13or16(mode0 & tmod_mode, timers.high0, timers.low0, elapsed);
+		if (overflow) {
+			control |= tcon_tf0;
+		}
+	}
+
+	if (run1 && (mode1 & tmod_mode) != 3) {
+		bool overflow = (mode1 & tmod_mode) == 2 ? count8(timers.low1, timers.high1, elapsed) :
+			count13or16(mode1 & tmod_mode, timers.high1, timers.low1, elapsed);
+		if (overflow && (mode0 & tmod_mode) != 3) {
+			control |= tcon_tf1;
+		}
+	}
+	return timers;
+}
+
+//cycles is read before timersSynced, so a sync running on the emulation
+//thread at the same time can only make the span look shorter
+cpu::timers_t cpu::peekTimers() const
+{
+	unsigned long long now = cycles;
+	unsigned long long synced = timersSynced;
+	return countTimers(now > synced ? now - synced : 0);
+}
+
+void cpu::syncTimers()
+{
+	unsigned long long elapsed = cycles - timersSynced;
+	timersSynced = cycles;
+	if (elapsed == 0) {
+		return;
+	}
+
+	timers_t timers = countTimers(elapsed);
+	uchar flags = sfr[tcon - sfr_base];
+	sfr[tcon - sfr_base] = timers.control;
+	sfr[th0 - sfr_base] = timers.high0;
+	sfr[tl0 - sfr_base] = timers.low0;
+	sfr[th1 - sfr_base] = timers.high1;
+	sfr[tl1 - sfr_base] = timers.low1;
+	if (timers.control != flags) {
+		updateInterrupts();
+	}
+}
+
+//Only overflows that would set a flag still clear are scheduled; a write
+//to TCON that clears one schedules again.
+void cpu::scheduleTimers()
+{
+	syncTimers();
+	uchar control = sfr[tcon - sfr_base];
+	uchar modes = sfr[tmod - sfr_base];
+	uchar pins = sfr[p3 - sfr_base];
+	uchar mode0 = modes & 0x0F;
+	uchar mode1 = modes >> 4;
+	uchar high0 = sfr[th0 - sfr_base];
+	uchar low0 = sfr[tl0 - sfr_base];
+	bool run0 = running(control, tcon_tr0, mode0, pins, p3_int0);
+	bool run1 = running(control, tcon_tr1, mode1, pins, p3_int1);
+
+	unsigned long long next = never;
+	if ((mode0 & tmod_mode) == 3) {
+		if (run0 && !(control & tcon_tf0)) {
+			next = 0x100 - low0;
+		}
+		if ((control & tcon_tr1) && !(control & tcon_tf1)) {
+			next = std::min<unsigned long long>(next, 0x100 - high0);
+		}
+	}
+	else {
+		if (run0 && !(control & tcon_tf0)) {
+			next = untilOverflow(mode0 & tmod_mode, high0, low0);
+		}
+		if (run1 && (mode1 & tmod_mode) != 3 && !(control & tcon_tf1)) {
+			next = std::min(next, untilOverflow(mode1 & tmod_mode,
+				sfr[th1 - sfr_base], sfr[tl1 - sfr_base]));
+		}
+	}
+
+	if (next == never) {
+		cancelEvent(timerEvent);
+	}
+	else {
+		scheduleEvent(timerEvent, cycles + next);
+	}
+}
+
+void cpu::timerOverflow()
+{
+	scheduleTimers();
+}